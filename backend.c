@@ -1,4 +1,5 @@
 #include "backend.h"
+#include "poly.h"
 #include <ctype.h>
 #include <math.h>
 
@@ -20,9 +21,12 @@ const char* tok_typ_to_str(TokenType tokenType) {
         STRINGIFY_ENUM_CASE(TOKEN_ID)
         STRINGIFY_ENUM_CASE(TOKEN_SIN)
         STRINGIFY_ENUM_CASE(TOKEN_COS)
+        STRINGIFY_ENUM_CASE(TOKEN_LOG)
         STRINGIFY_ENUM_CASE(TOKEN_EQ)
         STRINGIFY_ENUM_CASE(TOKEN_LEFT_PAREN)
         STRINGIFY_ENUM_CASE(TOKEN_RIGHT_PAREN)
+        STRINGIFY_ENUM_CASE(TOKEN_SEMICOLON)
+        STRINGIFY_ENUM_CASE(TOKEN_BAR)
         STRINGIFY_ENUM_CASE(TOKEN_EOF)
         STRINGIFY_ENUM_CASE(TOKEN_UNKNOWN)
         default: return "UNKNOWN_TOKEN_TYPE";
@@ -31,6 +35,8 @@ const char* tok_typ_to_str(TokenType tokenType) {
 const char *opcode_to_str(Opcode opcode) {
     switch (opcode) {
         STRINGIFY_ENUM_CASE(OP_CONST)
+        STRINGIFY_ENUM_CASE(OP_VAR)
+        STRINGIFY_ENUM_CASE(OP_PARAM)
         STRINGIFY_ENUM_CASE(OP_ADD)
         STRINGIFY_ENUM_CASE(OP_SUB)
         STRINGIFY_ENUM_CASE(OP_MUL)
@@ -40,6 +46,11 @@ const char *opcode_to_str(Opcode opcode) {
         STRINGIFY_ENUM_CASE(OP_SIN)
         STRINGIFY_ENUM_CASE(OP_COS)
         STRINGIFY_ENUM_CASE(OP_DONE)
+        STRINGIFY_ENUM_CASE(OP_STORE)
+        STRINGIFY_ENUM_CASE(OP_LOAD)
+        STRINGIFY_ENUM_CASE(OP_ABS)
+        STRINGIFY_ENUM_CASE(OP_LOG)
+        STRINGIFY_ENUM_CASE(OP_POLY)
         default: return "UNKNOWN_OPCODE";
     }
 }
@@ -82,6 +93,7 @@ static Token scan_single(Lexer *l) {
 
         CHECK_KW("sin", TOKEN_SIN)
         CHECK_KW("cos", TOKEN_COS)
+        CHECK_KW("log", TOKEN_LOG)
 
         return (Token){ TOKEN_ID, true, id };
     }
@@ -114,6 +126,8 @@ static Token scan_single(Lexer *l) {
     if (current(l) == '=') { (void) next(l); return (Token){ TOKEN_EQ,    true, "=" }; }
     if (current(l) == '(') { (void) next(l); return (Token){ TOKEN_LEFT_PAREN,  true, "(" }; }
     if (current(l) == ')') { (void) next(l); return (Token){ TOKEN_RIGHT_PAREN, true, ")" }; }
+    if (current(l) == ';') { (void) next(l); return (Token){ TOKEN_SEMICOLON,   true, ";" }; }
+    if (current(l) == '|') { (void) next(l); return (Token){ TOKEN_BAR,         true, "|" }; }
 
     printf("Unexpected character '%c'.\n", current(l));
     return (Token){ TOKEN_UNKNOWN, true, NULL };
@@ -121,17 +135,17 @@ static Token scan_single(Lexer *l) {
 
 #undef CHECK_KW
 
+static Token scan_next(Lexer *l) {
+    while (isspace(current(l))) ++l->idx;
+    l->next_start = l->idx;
+    return scan_single(l);
+}
+
 Token scan(Lexer *l) {
-    if (l->idx >= strlen(l->input)) return l->next;
-    if (!l->next.exists) {
-        Token c = scan_single(l);
-        l->next = scan_single(l);
-        return c;
-    } else {
-        Token c = l->next;
-        l->next = scan_single(l);
-        return c;
-    }
+    if (!l->next.exists) l->next = scan_next(l);
+    Token c = l->next;
+    l->next = scan_next(l); // once the input runs out, this is TOKEN_EOF
+    return c;
 }
 
 void print_tok(Token tok) {
@@ -154,21 +168,179 @@ static bool consume(Parser *p, TokenType typ) {
     return true;
 }
 
+static void reserve(Parser *p, unsigned int n) {
+    if (p->out_idx + n <= p->out.length) return;
+    p->out.length = (p->out_idx + n) * 2;
+    p->out.data = realloc(p->out.data, p->out.length);
+}
+
 void emitOp(Parser *p, Opcode op) {
+    reserve(p, 1);
     p->out.data[p->out_idx++] = op;
 }
+void emitByte(Parser *p, unsigned char b) {
+    reserve(p, 1);
+    p->out.data[p->out_idx++] = b;
+}
 void emitComp(Parser *p, Complex c) {
+    reserve(p, sizeof(float) * 2);
     *((float *)(p->out.data+(p->out_idx))) = c.real;
     p->out_idx += sizeof(float);
     *((float *)(p->out.data+(p->out_idx))) = c.imag;
     p->out_idx += sizeof(float);
 }
 
+static unsigned char new_local(Parser *p) {
+    if (p->local_count >= MAX_LOCALS) {
+        printf("Too many local values.\n");
+        exit(EXIT_FAILURE);
+    }
+    return p->local_count++;
+}
+static int find_binding(Parser *p, const char *name) {
+    for (int i = p->binding_count - 1; i >= 0; --i)
+        if (!strcmp(p->bindings[i].name, name)) return i;
+    return -1;
+}
+static Function *find_function(Parser *p, const char *name) {
+    for (int i = p->function_count - 1; i >= 0; --i)
+        if (!strcmp(p->functions[i].name, name)) return &p->functions[i];
+    return NULL;
+}
+
+// name = expr
+static void binding(Parser *p, char *name) {
+    if (!strcmp(name, "z")) {
+        printf("Can't assign to z.\n");
+        exit(EXIT_FAILURE);
+    }
+    expr(p);
+
+    unsigned char slot = new_local(p);
+    emitOp(p, OP_STORE);
+    emitByte(p, slot);
+    p->bindings[p->binding_count++] = (Binding){ name, slot };
+}
+
+// f(param) = body. The body is only checked when it's inlined, so here we just remember its source.
+static void function(Parser *p, char *name, char *param) {
+    if (p->function_count >= MAX_FUNCTIONS) {
+        printf("Too many functions.\n");
+        exit(EXIT_FAILURE);
+    }
+    unsigned int start = p->l->next_start;
+    while (!next_is(p, TOKEN_SEMICOLON) && !next_is(p, TOKEN_EOF)) {
+        Token t = scan(p->l);
+        if (t.typ == TOKEN_ID) free(t.data.str);
+    }
+    unsigned int length = p->l->next_start - start;
+
+    char *body = malloc(length + 2);
+    body[0] = '#'; // leading token, same as compile() expects
+    memcpy(body + 1, p->l->input + start, length);
+    body[length + 1] = 0;
+
+    unsigned int i = p->function_count++;
+    p->functions[i] = (Function){ name, param, body, p->binding_count, i };
+}
+
+// A binding or function definition, if that's what comes next
+static bool definition(Parser *p) {
+    if (!next_is(p, TOKEN_ID)) return false;
+    Lexer saved = *p->l;
+
+    Token name = scan(p->l);
+    if (consume(p, TOKEN_EQ)) {
+        binding(p, name.data.str);
+        return true;
+    }
+    if (consume(p, TOKEN_LEFT_PAREN) && next_is(p, TOKEN_ID)) {
+        Token param = scan(p->l);
+        if (consume(p, TOKEN_RIGHT_PAREN) && consume(p, TOKEN_EQ)) {
+            function(p, name.data.str, param.data.str);
+            return true;
+        }
+        free(param.data.str);
+    }
+
+    // just an expression starting with an identifier. saved still owns the name.
+    *p->l = saved;
+    return false;
+}
+
+// f(arg): evaluate arg once into a local, then compile the body in place with param bound to it
+static void call(Parser *p, Function *f) {
+    if (!consume(p, TOKEN_LEFT_PAREN)) {
+        printf("Expected '(' after function '%s'.\n", f->name);
+        exit(EXIT_FAILURE);
+    }
+    expr(p);
+    if (!consume(p, TOKEN_RIGHT_PAREN)) {
+        printf("Expected closing parenthese.\n");
+        exit(EXIT_FAILURE);
+    }
+    unsigned char slot = new_local(p);
+    emitOp(p, OP_STORE);
+    emitByte(p, slot);
+
+    // the body sees what was in scope at its definition, plus its parameter.
+    // a function can't see itself, so inlining always terminates.
+    unsigned int bindings = p->binding_count, functions = p->function_count;
+    unsigned int hidden = bindings - f->bindings;
+    Binding *saved = malloc((hidden + 1) * sizeof(Binding));
+    memcpy(saved, p->bindings + f->bindings, hidden * sizeof(Binding));
+    p->binding_count = f->bindings;
+    p->function_count = f->functions;
+    p->bindings[p->binding_count++] = (Binding){ f->param, slot };
+
+    Lexer body = { f->body, 0, {0, false, NULL} };
+    Lexer *outer = p->l;
+    p->l = &body;
+    (void) scan(p->l);
+    expr(p);
+    if (!next_is(p, TOKEN_EOF)) {
+        printf("Unexpected %s in body of '%s'.\n", tok_typ_to_str(p->l->next.typ), f->name);
+        exit(EXIT_FAILURE);
+    }
+    p->l = outer;
+
+    memcpy(p->bindings + f->bindings, saved, hidden * sizeof(Binding));
+    p->binding_count = bindings;
+    p->function_count = functions;
+    free(saved);
+}
+
 void compile(Parser *p) {
     (void) scan(p->l); // we need a leading token to correctly start parsing. we use a hash.
                        // there's probably a better way, but this works fine and it's not hard.
-    expr(p);
+    do {
+        if (next_is(p, TOKEN_EOF)) break; // trailing ';'
+        if (definition(p)) continue;
+
+        // each expression is an output, left on the stack
+        expr(p);
+        ++p->output_count;
+    } while (consume(p, TOKEN_SEMICOLON));
+
+    if (!next_is(p, TOKEN_EOF)) {
+        printf("Expected ';' or end of input. %s\n", tok_typ_to_str(p->l->next.typ));
+        exit(EXIT_FAILURE);
+    }
+    if (!p->output_count) {
+        printf("Expected an expression.\n");
+        exit(EXIT_FAILURE);
+    }
     emitOp(p, OP_DONE);
+
+    // rebuild through the DAG so subexpressions shared between outputs
+    // (or repeated by inlining) are only computed once
+    p->out.length = p->out_idx;
+    Dag dag = build_dag(p->out);
+    free(p->out.data);
+    dag_fuse_polynomials(&dag);
+    p->out = emit_dag(&dag, dag.outputs, dag.output_count);
+    p->out_idx = p->out.length;
+    free_dag(&dag);
 }
 void expr(Parser *p) {
     term(p);
@@ -190,8 +362,8 @@ void term(Parser *p) {
 
         // right operand
         factor(p);
-        if (plus ) emitOp(p, TOKEN_PLUS );
-        if (minus) emitOp(p, TOKEN_MINUS);
+        if (plus ) emitOp(p, OP_ADD);
+        if (minus) emitOp(p, OP_SUB);
     }
 }
 void factor(Parser *p) {
@@ -210,8 +382,8 @@ void factor(Parser *p) {
 
         // right operand
         unary(p);
-        if (mult) emitOp(p, TOKEN_MULT);
-        if (div ) emitOp(p, TOKEN_DIV );
+        if (mult) emitOp(p, OP_MUL);
+        if (div ) emitOp(p, OP_DIV);
     }
 }
 void unary(Parser *p) {
@@ -233,6 +405,12 @@ void unary(Parser *p) {
         emitOp(p, OP_COS);
         return;
     }
+    if (consume(p, TOKEN_LOG)) {
+        // operand
+        unary(p);
+        emitOp(p, OP_LOG);
+        return;
+    }
     exponent(p);
 }
 void exponent(Parser *p) {
@@ -254,8 +432,55 @@ void primary(Parser *p) {
         emitComp(p, n.data.num);
         return;
     }
+    if (next_is(p, TOKEN_ID)) {
+        Token id = scan(p->l);
+        // bindings first, so a function parameter named z hides the real one
+        int b = find_binding(p, id.data.str);
+        if (b >= 0) {
+            free(id.data.str);
+            emitOp(p, OP_LOAD);
+            emitByte(p, p->bindings[b].slot);
+            return;
+        }
+        if (!strcmp(id.data.str, "z")) {
+            free(id.data.str);
+            emitOp(p, OP_VAR);
+            return;
+        }
+        Function *f = find_function(p, id.data.str);
+        if (f) {
+            free(id.data.str);
+            call(p, f);
+            return;
+        }
+
+        // anything else is a parameter, bound at evaluation time
+        int slot = param_slot(p, id.data.str);
+        if (slot < 0) {
+            if (p->param_count >= MAX_PARAMS) {
+                printf("Too many parameters.\n");
+                exit(EXIT_FAILURE);
+            }
+            slot = p->param_count;
+            p->params[p->param_count++] = id.data.str;
+        } else {
+            free(id.data.str);
+        }
+        emitOp(p, OP_PARAM);
+        emitByte(p, slot);
+        return;
+    }
+    if (consume(p, TOKEN_BAR)) {
+        expr(p);
+        if (!consume(p, TOKEN_BAR)) {
+            printf("Expected closing '|'.\n");
+            exit(EXIT_FAILURE);
+        }
+        emitOp(p, OP_ABS);
+        return;
+    }
     if (next_is(p, TOKEN_LEFT_PAREN)) return paren(p);
-    printf("Expected number or parentheses. %s\n", tok_typ_to_str(p->l->next.typ));
+    printf("Expected number, identifier, parentheses or '|'. %s\n", tok_typ_to_str(p->l->next.typ));
     exit(EXIT_FAILURE);
 }
 void paren(Parser *p) {
@@ -270,6 +495,12 @@ void paren(Parser *p) {
     }
 }
 
+int param_slot(Parser *p, const char *name) {
+    for (unsigned int i = 0; i < p->param_count; ++i)
+        if (!strcmp(p->params[i], name)) return i;
+    return -1;
+}
+
 void disasm(Bytecode bc) {
     unsigned int idx = 0;
     while (idx < bc.length) {
@@ -278,8 +509,24 @@ void disasm(Bytecode bc) {
                 printf("OP_CONST (%f + %fi)\n", *((float *)(bc.data + idx + 1)), *((float *)(bc.data + idx + 1 + sizeof(float))));
                 idx += 1 + sizeof(float) * 2;
                 break;
+            case OP_PARAM:
+            case OP_STORE:
+            case OP_LOAD:
+                printf("%s %u\n", opcode_to_str(bc.data[idx]), bc.data[idx + 1]);
+                idx += 2;
+                break;
+            case OP_POLY: {
+                unsigned int degree = bc.data[idx + 1] | bc.data[idx + 2] << 8;
+                const Complex *c = (const Complex *)(bc.data + idx + 3);
+                printf("OP_POLY");
+                for (unsigned int k = 0; k <= degree; ++k) printf(" (%f + %fi)", c[k].real, c[k].imag);
+                printf("\n");
+                idx += 3 + (degree + 1) * sizeof(Complex);
+                break;
+            }
             
             default:
+            case OP_VAR:
             case OP_ADD:
             case OP_SUB:
             case OP_MUL:
@@ -288,6 +535,8 @@ void disasm(Bytecode bc) {
             case OP_NEG:
             case OP_SIN:
             case OP_COS:
+            case OP_ABS:
+            case OP_LOG:
                 printf("%s\n", opcode_to_str(bc.data[idx]));
                 ++idx;
                 break;
@@ -360,6 +609,35 @@ Complex complex_cos(Complex z) {
     Complex denominator = {2, 0};
     return complex_div(numerator, denominator);
 }
+Complex complex_log(Complex z) {
+    // principal branch, same one complex_pow uses: ln|z| + i*arg(z)
+    Complex result;
+    result.real = logf(sqrtf(z.real * z.real + z.imag * z.imag));
+    result.imag = atan2f(z.imag, z.real);
+    return result;
+}
+Complex complex_poly(const Complex *c, unsigned int degree, Complex z) {
+    if (degree < 8) {
+        // Horner
+        Complex r = c[degree];
+        for (unsigned int k = degree; k-- > 0;) r = complex_add(complex_mul(r, z), c[k]);
+        return r;
+    }
+
+    // Estrin within blocks of four, which don't depend on each other,
+    // then Horner in z^4 over the blocks
+    Complex z2 = complex_mul(z, z), z4 = complex_mul(z2, z2);
+    Complex r = { 0.0f, 0.0f };
+    unsigned int top = degree / 4 * 4;
+    for (unsigned int k = top + 4; k >= 4; k -= 4) {
+        unsigned int b = k - 4;
+        Complex lo = complex_add(c[b], complex_mul(b + 1 <= degree ? c[b + 1] : (Complex){ 0.0f, 0.0f }, z));
+        Complex hi = b + 2 > degree ? (Complex){ 0.0f, 0.0f } :
+                     complex_add(c[b + 2], complex_mul(b + 3 <= degree ? c[b + 3] : (Complex){ 0.0f, 0.0f }, z));
+        r = complex_add(complex_mul(r, z4), complex_add(lo, complex_mul(hi, z2)));
+    }
+    return r;
+}
 Complex complex_tan(Complex z) {
     // tan(z) = sin(z) / cos(z)
     Complex sin_z = complex_sin(z);
@@ -367,18 +645,34 @@ Complex complex_tan(Complex z) {
     return complex_div(sin_z, cos_z);
 }
 
-Complex run(Bytecode bc) {
-    Complex stack[256]; // TODO: dynamically grow this if needed
+static unsigned int exec(Bytecode bc, Complex z, const Complex *params, Complex *stack) {
+    Complex locals[MAX_LOCALS];
     unsigned int sp = 0;
     unsigned int idx = 0;
     Complex l,r;
     while (idx < bc.length) {
         switch (bc.data[idx]) {
             case OP_CONST:
-                Complex z = { *((float *)(bc.data + idx + 1)), *((float *)(bc.data + idx + 1 + sizeof(float))) };
-                stack[sp++] = z;
+                Complex c = { *((float *)(bc.data + idx + 1)), *((float *)(bc.data + idx + 1 + sizeof(float))) };
+                stack[sp++] = c;
                 idx += 1 + sizeof(float) * 2;
                 break;
+            case OP_VAR:
+                stack[sp++] = z;
+                ++idx;
+                break;
+            case OP_PARAM:
+                stack[sp++] = params[bc.data[idx + 1]];
+                idx += 2;
+                break;
+            case OP_STORE:
+                locals[bc.data[idx + 1]] = stack[--sp];
+                idx += 2;
+                break;
+            case OP_LOAD:
+                stack[sp++] = locals[bc.data[idx + 1]];
+                idx += 2;
+                break;
             
             case OP_ADD:
                 r = stack[--sp];
@@ -425,12 +719,40 @@ Complex run(Bytecode bc) {
                 stack[sp++] = complex_cos(r);
                 ++idx;
                 break;
+            case OP_ABS:
+                r = stack[--sp];
+                stack[sp++] = complex_mag(r);
+                ++idx;
+                break;
+            case OP_LOG:
+                r = stack[--sp];
+                stack[sp++] = complex_log(r);
+                ++idx;
+                break;
+            case OP_POLY: {
+                unsigned int degree = bc.data[idx + 1] | bc.data[idx + 2] << 8;
+                stack[sp - 1] = complex_poly((const Complex *)(bc.data + idx + 3), degree, stack[sp - 1]);
+                idx += 3 + (degree + 1) * sizeof(Complex);
+                break;
+            }
 
             case OP_DONE:
-                return stack[--sp];
-                break;
+                return sp;
             
-            default: printf("UNKNOWN\n"); return (Complex){ 0.0f, 0.0f };
+            default: printf("UNKNOWN\n"); stack[0] = (Complex){ 0.0f, 0.0f }; return 1;
         }
     }
+    return sp;
+}
+
+Complex run(Bytecode bc, Complex z, const Complex *params) {
+    Complex stack[256]; // TODO: dynamically grow this if needed
+    unsigned int sp = exec(bc, z, params, stack);
+    return stack[sp - 1];
+}
+unsigned int run_all(Bytecode bc, Complex z, const Complex *params, Complex *out) {
+    Complex stack[256];
+    unsigned int sp = exec(bc, z, params, stack);
+    memcpy(out, stack, sp * sizeof(Complex));
+    return sp;
 }
\ No newline at end of file
@@ -7,11 +7,14 @@
 #include <string.h>
 
 typedef enum Opcode {
-    OP_CONST,
+    OP_CONST, OP_VAR, OP_PARAM,
     OP_ADD, OP_SUB,
     OP_MUL, OP_DIV, OP_NEG,
     OP_SIN, OP_COS,
-    OP_POW, OP_DONE
+    OP_POW, OP_DONE,
+    OP_STORE, OP_LOAD,
+    OP_ABS, OP_LOG,
+    OP_POLY // 2 byte degree, then degree + 1 coefficients lowest first
 } Opcode;
 
 typedef enum TokenType {
@@ -20,8 +23,9 @@ typedef enum TokenType {
     TOKEN_MULT, TOKEN_DIV,
     TOKEN_POW, TOKEN_HASH,
     TOKEN_ID, TOKEN_EQ,
-    TOKEN_SIN, TOKEN_COS,
+    TOKEN_SIN, TOKEN_COS, TOKEN_LOG,
     TOKEN_LEFT_PAREN, TOKEN_RIGHT_PAREN,
+    TOKEN_SEMICOLON, TOKEN_BAR,
 
     TOKEN_EOF, TOKEN_UNKNOWN
 } TokenType;
@@ -49,6 +53,7 @@ typedef struct Lexer {
     unsigned int idx;
 
     Token next;
+    unsigned int next_start; // where the next token begins in input
 } Lexer;
 
 typedef struct Bytecode {
@@ -56,10 +61,38 @@ typedef struct Bytecode {
     unsigned char *data;
 } Bytecode;
 
+#define MAX_PARAMS 256 // parameter slots are addressed by a single byte
+#define MAX_LOCALS 256 // so are local slots
+#define MAX_FUNCTIONS 64
+
+typedef struct Binding {
+    char *name;
+    unsigned char slot;
+} Binding;
+
+// f(param) = body. Inlined at every call.
+typedef struct Function {
+    char *name;
+    char *param;
+    char *body;
+    unsigned int bindings, functions; // what was visible where it was defined
+} Function;
+
 typedef struct Parser {
     Lexer *l;
-    Bytecode out;
+    Bytecode out; // grown as needed, so read it back after compiling
     unsigned int out_idx;
+
+    char *params[MAX_PARAMS]; // parameter names, indexed by slot
+    unsigned int param_count;
+
+    Binding bindings[MAX_LOCALS]; // innermost last
+    unsigned int binding_count;
+    unsigned int local_count;
+    Function functions[MAX_FUNCTIONS];
+    unsigned int function_count;
+
+    unsigned int output_count; // values the program leaves, one per expression statement
 } Parser;
 
 char next(Lexer *lexer);
@@ -69,14 +102,16 @@ Token scan(Lexer *lexer);
 void print_tok(Token tok);
 void print_comp(Complex c);
 
-void compile(Parser *parser);  // Compile. This is essentially an alias for expr
+void compile(Parser *parser);  // Compile a program: expressions, bindings and definitions separated by ';'
 void expr(Parser *parser);     // Expression
 void paren(Parser *parser);    // Parenthesized expression
 void exponent(Parser *parser); // Exponent (a^b)
 void factor(Parser *parser);   // Mult/div
 void unary(Parser *parser);    // Negation, functions (sin, cos, log, etc.)
 void term(Parser *parser);     // Add/sub
-void primary(Parser *parser);  // Number constant
+void primary(Parser *parser);  // Number constant, z, parameter or |modulus|
+
+int param_slot(Parser *parser, const char *name); // Slot of a named parameter, or -1
 
 void disasm(Bytecode bc);
 
@@ -85,7 +120,17 @@ Complex complex_sub(Complex z1, Complex z2);
 Complex complex_mul(Complex z1, Complex z2);
 Complex complex_div(Complex z1, Complex z2);
 Complex complex_pow(Complex z1, Complex z2);
-
-Complex run(Bytecode bc);
+Complex complex_mag(Complex z);
+Complex complex_exp(Complex z);
+Complex complex_sin(Complex z);
+Complex complex_cos(Complex z);
+Complex complex_log(Complex z);
+Complex complex_poly(const Complex *coefficients, unsigned int degree, Complex z); // lowest first
+
+// Evaluate at z. params[slot] holds the value of each named parameter,
+// and may be NULL if the program has none. Returns the last output.
+Complex run(Bytecode bc, Complex z, const Complex *params);
+// Like run, but copies every output into out and returns how many there were.
+unsigned int run_all(Bytecode bc, Complex z, const Complex *params, Complex *out);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,464 @@
+#include "batch.h"
+#include "derive.h"
+#include "poly.h"
+#include "fft.h"
+#include <math.h>
+
+// Below this many points, hoisting costs more than it saves
+#define HOIST_MIN_POINTS 16
+// Polynomial grid rows go by forward differences up to this degree, starting
+// over from the coefficients every RESEED points to keep rounding in check
+#define MAX_DIFFERENCE_DEGREE 32
+#define RESEED 64
+// Below these, evaluating points one by one is as quick as an FFT
+#define FFT_MIN_DEGREE 16
+#define FFT_MIN_POINTS 64
+
+// Whether node i is a z + b, with a and b independent of z.
+// known is 0 for not worked out yet, 1 for affine and 2 for not.
+static bool affine(Dag *dag, const bool *varies, unsigned int i, unsigned char *known) {
+    if (!varies[i]) return true;
+    if (known[i]) return known[i] == 1;
+    Node n = dag->nodes[i];
+    bool yes;
+    switch (n.op) {
+        case OP_VAR: yes = true; break;
+        case OP_ADD:
+        case OP_SUB: yes = affine(dag, varies, n.a, known) && affine(dag, varies, n.b, known); break;
+        case OP_NEG: yes = affine(dag, varies, n.a, known); break;
+        case OP_MUL: yes = (!varies[n.a] && affine(dag, varies, n.b, known)) ||
+                           (!varies[n.b] && affine(dag, varies, n.a, known)); break;
+        case OP_DIV: yes = !varies[n.b] && affine(dag, varies, n.a, known); break;
+        default:     yes = false; break;
+    }
+    known[i] = yes ? 1 : 2;
+    return yes;
+}
+
+Kernel hoist(Bytecode bc) {
+    Dag dag = build_dag(bc);
+    bool *varies = dag_varies(&dag);
+
+    // hoisted values go in the slots after the program's own parameters
+    unsigned int first_slot = 0;
+    for (unsigned int i = 0; i < dag.count; ++i)
+        if (dag.nodes[i].op == OP_PARAM && dag.nodes[i].slot >= first_slot)
+            first_slot = dag.nodes[i].slot + 1;
+
+    // hoist every invariant subexpression that feeds something varying,
+    // or is an output by itself. leaves are already as cheap as a load.
+    bool *hoisted = calloc(dag.count, sizeof(bool));
+    for (unsigned int i = 0; i < dag.count; ++i) {
+        Node n = dag.nodes[i];
+        if (!varies[i]) continue;
+        if (n.a != NO_NODE && !varies[n.a]) hoisted[n.a] = true;
+        if (n.b != NO_NODE && !varies[n.b]) hoisted[n.b] = true;
+    }
+    for (unsigned int i = 0; i < dag.output_count; ++i)
+        if (!varies[dag.outputs[i]]) hoisted[dag.outputs[i]] = true;
+
+    unsigned int nodes = dag.count; // before anything gets added
+    unsigned int *roots = malloc((nodes + 2 * MAX_SEPARABLE + MAX_DIFFERENCE_DEGREE + 2) * sizeof(unsigned int));
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < nodes && first_slot + count < MAX_PARAMS; ++i)
+        if (hoisted[i] && arity(dag.nodes[i].op) > 0) roots[count++] = i;
+
+    Kernel k;
+    k.first_slot = first_slot;
+    k.hoisted = count;
+    k.outputs = dag.output_count;
+
+    // sin, cos and c^u of affine arguments. The prologue works out alpha
+    // as the derivative of the argument, and beta as the argument at z = 0.
+    unsigned char *known = calloc(nodes, sizeof(unsigned char));
+    unsigned int *memo = malloc(nodes * sizeof(unsigned int));
+    for (unsigned int i = 0; i < nodes; ++i) memo[i] = NO_NODE;
+    unsigned int targets[MAX_SEPARABLE];
+    k.separable_count = 0;
+    for (unsigned int i = 0; i < nodes && k.separable_count < MAX_SEPARABLE; ++i) {
+        if (first_slot + count + 3 * (k.separable_count + 1) > MAX_PARAMS) break;
+        Node n = dag.nodes[i];
+        if (!varies[i]) continue;
+
+        unsigned int alpha, beta;
+        if ((n.op == OP_SIN || n.op == OP_COS) && affine(&dag, varies, n.a, known)) {
+            alpha = dag_derive(&dag, n.a, memo);
+            beta = n.a;
+        } else if (n.op == OP_POW && !varies[n.a] && affine(&dag, varies, n.b, known)) {
+            // c^u = exp(u log c)
+            unsigned int log_c = dag_node(&dag, (Node){ OP_LOG, n.a, NO_NODE, { 0.0f, 0.0f }, 0 });
+            alpha = dag_node(&dag, (Node){ OP_MUL, dag_derive(&dag, n.b, memo), log_c, { 0.0f, 0.0f }, 0 });
+            beta = dag_node(&dag, (Node){ OP_MUL, n.b, log_c, { 0.0f, 0.0f }, 0 });
+        } else {
+            continue;
+        }
+        unsigned int j = k.separable_count++;
+        roots[count + 2 * j] = alpha;
+        roots[count + 2 * j + 1] = beta;
+        targets[j] = i;
+        k.separable[j] = (Separable){
+            n.op, first_slot + count + 2 * j, first_slot + count + 2 * j + 1, 0
+        };
+    }
+
+    // a polynomial output gets its coefficients in the slots after those,
+    // if there's room, and a table if they're constants. Only sums of c z^k
+    // though: expanding (z - 1)^20 is slow and throws away all the precision
+    // near the root
+    unsigned int used = count + 2 * k.separable_count;
+    unsigned int output = dag.outputs[dag.output_count - 1];
+    unsigned int *terms = malloc((MAX_POLY_DEGREE + 1) * sizeof(unsigned int));
+    int degree = -1;
+    if (dag_monomial_sum(&dag, output, varies) >= 0)
+        degree = dag_polynomial(&dag, output, varies, MAX_POLY_DEGREE, terms);
+    k.degree = 0;
+    k.coefficients = first_slot + used;
+    if (degree > 0 && degree <= MAX_DIFFERENCE_DEGREE && first_slot + used + degree + 1 + k.separable_count <= MAX_PARAMS) {
+        k.degree = degree;
+        memcpy(roots + used, terms, (degree + 1) * sizeof(unsigned int));
+        used += degree + 1;
+    }
+
+    k.table = NULL;
+    k.table_degree = 0;
+    bool constant = degree >= FFT_MIN_DEGREE && first_slot + used + 1 + k.separable_count <= MAX_PARAMS;
+    for (int i = 1; constant && i <= degree; ++i) constant = dag.nodes[terms[i]].op == OP_CONST;
+    if (constant) {
+        k.table = malloc((degree + 1) * sizeof(Complex));
+        k.table[0] = (Complex){ 0.0f, 0.0f };
+        for (int i = 1; i <= degree; ++i) k.table[i] = dag.nodes[terms[i]].value;
+        k.table_degree = degree;
+        k.constant_term = first_slot + used;
+        roots[used++] = terms[0];
+    }
+    free(terms);
+
+    for (unsigned int j = 0; j < k.separable_count; ++j)
+        k.separable[j].slot = first_slot + used + j;
+    k.prologue = emit_dag(&dag, roots, used);
+
+    // the body reads each hoisted and separable value back as a parameter
+    for (unsigned int i = 0; i < count; ++i)
+        dag.nodes[roots[i]] = (Node){ OP_PARAM, NO_NODE, NO_NODE, { 0.0f, 0.0f }, first_slot + i };
+    for (unsigned int j = 0; j < k.separable_count; ++j)
+        dag.nodes[targets[j]] = (Node){ OP_PARAM, NO_NODE, NO_NODE, { 0.0f, 0.0f }, k.separable[j].slot };
+    k.body = emit_dag(&dag, dag.outputs, dag.output_count);
+
+    free(memo);
+    free(known);
+    free(roots);
+    free(hoisted);
+    free(varies);
+    free_dag(&dag);
+    return k;
+}
+
+void free_kernel(Kernel *k) {
+    free(k->table);
+    free(k->prologue.data);
+    free(k->body.data);
+    *k = (Kernel){ 0 };
+}
+
+void kernel_slots(Kernel k, const Complex *params, Complex *slots) {
+    if (params) memcpy(slots, params, k.first_slot * sizeof(Complex));
+    // separable arguments get evaluated at z = 0 for their betas
+    if (k.hoisted || k.separable_count || k.degree || k.table) (void) run_all(k.prologue, (Complex){ 0.0f, 0.0f }, slots, slots + k.first_slot);
+}
+
+static void separate(Kernel k, Complex z, Complex *slots) {
+    for (unsigned int j = 0; j < k.separable_count; ++j) {
+        Separable s = k.separable[j];
+        Complex u = complex_add(complex_mul(slots[s.alpha], z), slots[s.beta]);
+        slots[s.slot] = s.op == OP_SIN ? complex_sin(u) : s.op == OP_COS ? complex_cos(u) : complex_exp(u);
+    }
+}
+
+Complex kernel_point(Kernel k, Complex z, Complex *slots) {
+    separate(k, z, slots);
+    return run(k.body, z, slots);
+}
+
+static void body(Kernel k, const Complex *zs, unsigned int n, Complex *slots, Complex **outs) {
+    if (k.outputs == 1) {
+        for (unsigned int i = 0; i < n; ++i)
+            outs[0][i] = kernel_point(k, zs[i], slots);
+        return;
+    }
+
+    // one sweep over the points fills every output
+    Complex values[256];
+    for (unsigned int i = 0; i < n; ++i) {
+        separate(k, zs[i], slots);
+        (void) run_all(k.body, zs[i], slots, values);
+        for (unsigned int j = 0; j < k.outputs; ++j)
+            if (outs[j]) outs[j][i] = values[j];
+    }
+}
+
+static Wide wide_add(Wide a, Wide b) {
+    return (Wide){ a.real + b.real, a.imag + b.imag };
+}
+static Wide wide_mul(Wide a, Wide b) {
+    return (Wide){ a.real * b.real - a.imag * b.imag, a.real * b.imag + a.imag * b.real };
+}
+
+// Whether zs[j] = center + (zs[0] - center) e^(sign 2 pi i j / n), to about float precision
+static bool on_circle(const Complex *zs, unsigned int n, Wide *center, int *sign) {
+    Wide c = { 0, 0 };
+    for (unsigned int j = 0; j < n; ++j) {
+        c.real += zs[j].real;
+        c.imag += zs[j].imag;
+    }
+    c = (Wide){ c.real / n, c.imag / n };
+    Wide s = { zs[0].real - c.real, zs[0].imag - c.imag };
+    double r = hypot(s.real, s.imag), tolerance = 1e-6 * (r + hypot(c.real, c.imag));
+    if (r <= tolerance) return false;
+
+    for (int way = 1; way >= -1; way -= 2) {
+        unsigned int j = 1;
+        for (; j < n; ++j) {
+            Wide w = { cos(2 * M_PI * j / n), way * sin(2 * M_PI * j / n) };
+            Wide z = wide_add(c, wide_mul(s, w));
+            if (hypot(zs[j].real - z.real, zs[j].imag - z.imag) > tolerance) break;
+        }
+        if (j == n) {
+            *center = c;
+            *sign = way;
+            return true;
+        }
+    }
+    return false;
+}
+
+// p(c + s w^j) = sum b_k s^k w^jk with b the Taylor coefficients at c. Powers
+// of w past n wrap around, so folding the terms mod n leaves a length n DFT.
+static bool circle_kernel(Kernel k, const Complex *zs, unsigned int n, const Complex *slots, Complex *out) {
+    Wide c;
+    int sign;
+    unsigned int d = k.table_degree;
+    if (!on_circle(zs, n, &c, &sign)) return false;
+    // shifting to the center costs d^2, more than it saves unless d <= n
+    bool centered = hypot(c.real, c.imag) <= 1e-6 * hypot(zs[0].real - c.real, zs[0].imag - c.imag);
+    if (!centered && d > n) return false;
+
+    Wide *b = malloc((d + 1) * sizeof(Wide));
+    b[0] = (Wide){ slots[k.constant_term].real, slots[k.constant_term].imag };
+    for (unsigned int i = 1; i <= d; ++i) b[i] = (Wide){ k.table[i].real, k.table[i].imag };
+    if (!centered)
+        for (unsigned int m = 0; m < d; ++m)
+            for (unsigned int j = d - 1; j + 1 > m; --j)
+                b[j] = wide_add(b[j], wide_mul(c, b[j + 1]));
+
+    Wide *folded = calloc(n, sizeof(Wide));
+    Wide s = { zs[0].real - (centered ? 0 : c.real), zs[0].imag - (centered ? 0 : c.imag) }, power = { 1, 0 };
+    bool finite = true;
+    for (unsigned int i = 0; i <= d; ++i, power = wide_mul(power, s)) {
+        folded[i % n] = wide_add(folded[i % n], wide_mul(b[i], power));
+        finite = finite && isfinite(power.real) && isfinite(power.imag);
+    }
+    if (finite) {
+        fft(folded, n, sign);
+        for (unsigned int j = 0; j < n; ++j) out[j] = (Complex){ (float)folded[j].real, (float)folded[j].imag };
+    }
+    free(folded);
+    free(b);
+    return finite;
+}
+
+void run_kernel(Kernel k, const Complex *zs, unsigned int n, const Complex *params, Complex **outs) {
+    Complex slots[MAX_PARAMS];
+    kernel_slots(k, params, slots);
+
+    bool last_only = true;
+    for (unsigned int j = 0; j + 1 < k.outputs; ++j) last_only = last_only && !outs[j];
+    if (k.table && n >= FFT_MIN_POINTS && last_only && circle_kernel(k, zs, n, slots, outs[k.outputs - 1])) return;
+    body(k, zs, n, slots, outs);
+}
+
+// exp(a t + b) c
+static Wide exp_factor(Complex a, double t, Complex b, Wide c) {
+    double m = exp(a.real * t + b.real), phase = a.imag * t + b.imag;
+    double re = m * cos(phase), im = m * sin(phase);
+    return wide_mul((Wide){ re, im }, c);
+}
+
+// On the grid z = x + iy, so alpha z + beta = alpha x + (i alpha y + beta):
+//   exp(u) = exp(alpha x) exp(i alpha y + beta)
+//   sin(u) = (exp(iu) - exp(-iu)) / 2i and cos(u) = (exp(iu) + exp(-iu)) / 2
+// which leaves one or two products of a column factor and a row factor.
+// cols and rows get 2 w and 2 h entries per separable value, for the
+// window of g at lattice point (x0, y0).
+static bool factor_tables(Kernel k, Grid g, unsigned int x0, unsigned int y0, const Complex *slots, Wide *cols, Wide *rows) {
+    for (unsigned int j = 0; j < k.separable_count; ++j) {
+        Separable s = k.separable[j];
+        Complex a = slots[s.alpha], b = slots[s.beta];
+        Complex ia = { -a.imag, a.real }, ib = { -b.imag, b.real };
+        Complex terms[2][2]; // alpha and beta for each exponential
+        Wide scale[2];
+        unsigned int n = 2;
+        if (s.op == OP_SIN) {
+            memcpy(terms, (Complex[2][2]){ { ia, ib }, { { -ia.real, -ia.imag }, { -ib.real, -ib.imag } } }, sizeof(terms));
+            scale[0] = (Wide){ 0, -0.5 };
+            scale[1] = (Wide){ 0, 0.5 };
+        } else if (s.op == OP_COS) {
+            memcpy(terms, (Complex[2][2]){ { ia, ib }, { { -ia.real, -ia.imag }, { -ib.real, -ib.imag } } }, sizeof(terms));
+            scale[0] = scale[1] = (Wide){ 0.5, 0 };
+        } else {
+            terms[0][0] = a;
+            terms[0][1] = b;
+            scale[0] = (Wide){ 1, 0 };
+            n = 1;
+        }
+
+        Wide *c = cols + (size_t)2 * j * g.w, *r = rows + (size_t)2 * j * g.h;
+        for (unsigned int t = 0; t < 2; ++t) {
+            Complex alpha = terms[t][0], beta = terms[t][1];
+            Complex i_alpha = { -alpha.imag, alpha.real };
+            for (unsigned int x = 0; x < g.w; ++x)
+                c[t * g.w + x] = t < n ? exp_factor(alpha, g.origin.real + (x0 + x) * g.dx, (Complex){ 0, 0 }, (Wide){ 1, 0 }) : (Wide){ 0, 0 };
+            for (unsigned int y = 0; y < g.h; ++y)
+                r[t * g.h + y] = t < n ? exp_factor(i_alpha, g.origin.imag + (y0 + y) * g.dy, beta, scale[t]) : (Wide){ 0, 0 };
+        }
+        for (unsigned int x = 0; x < 2 * g.w; ++x)
+            if (!isfinite(c[x].real) || !isfinite(c[x].imag)) return false;
+        for (unsigned int y = 0; y < 2 * g.h; ++y)
+            if (!isfinite(r[y].real) || !isfinite(r[y].imag)) return false;
+    }
+    return true;
+}
+
+// One row of a polynomial grid. With t counting points from a seed at z0,
+// p(z0 + t dx) = sum b_m t^m, and the forward differences there are
+// sum b_m j! S(m, j), S being Stirling numbers of the second kind. From
+// then on each point only costs degree adds. x0 and y are lattice indices in g.
+// Seeds go at multiples of RESEED in the whole lattice, not the window, so
+// every window takes the same steps to a point and neighbours agree on it.
+static void difference_row(Kernel k, const Complex *slots, Grid g, unsigned int x0, unsigned int y,
+                           double surjections[][MAX_DIFFERENCE_DEGREE + 1], Complex *out) {
+    unsigned int d = k.degree;
+    Wide b[MAX_DIFFERENCE_DEGREE + 1], delta[MAX_DIFFERENCE_DEGREE + 1];
+    for (unsigned int x = x0 / RESEED * RESEED; x < x0 + g.w; ++x) {
+        if (x % RESEED == 0) {
+            // Taylor coefficients at z0 by repeated synthetic division
+            Wide z0 = { g.origin.real + (double)x * g.dx, g.origin.imag + (double)y * g.dy };
+            for (unsigned int m = 0; m <= d; ++m)
+                b[m] = (Wide){ slots[k.coefficients + m].real, slots[k.coefficients + m].imag };
+            for (unsigned int m = 0; m < d; ++m)
+                for (unsigned int j = d - 1; j + 1 > m; --j)
+                    b[j] = wide_add(b[j], wide_mul(z0, b[j + 1]));
+
+            double step = 1;
+            for (unsigned int m = 0; m <= d; ++m, step *= g.dx) b[m] = (Wide){ b[m].real * step, b[m].imag * step };
+            for (unsigned int j = 0; j <= d; ++j) {
+                delta[j] = (Wide){ 0, 0 };
+                for (unsigned int m = j; m <= d; ++m)
+                    delta[j] = wide_add(delta[j], (Wide){ b[m].real * surjections[m][j], b[m].imag * surjections[m][j] });
+            }
+        }
+
+        if (x >= x0) out[x - x0] = (Complex){ (float)delta[0].real, (float)delta[0].imag };
+        for (unsigned int j = 0; j < d; ++j) delta[j] = wide_add(delta[j], delta[j + 1]);
+    }
+}
+
+void run_kernel_window(Kernel k, Grid lattice, unsigned int x0, unsigned int y0, unsigned int w, unsigned int h,
+                       const Complex *params, Complex *out) {
+    Grid g = lattice;
+    g.w = w;
+    g.h = h;
+    Complex slots[MAX_PARAMS];
+    kernel_slots(k, params, slots);
+
+    if (k.degree) {
+        // j! S(m, j), the number of ways onto j things from m
+        double surjections[MAX_DIFFERENCE_DEGREE + 1][MAX_DIFFERENCE_DEGREE + 1] = { { 1 } };
+        for (unsigned int m = 1; m <= k.degree; ++m)
+            for (unsigned int j = 1; j <= m; ++j)
+                surjections[m][j] = j * (surjections[m - 1][j - 1] + surjections[m - 1][j]);
+        for (unsigned int y = 0; y < g.h; ++y) difference_row(k, slots, g, x0, y0 + y, surjections, out + (size_t)y * g.w);
+        return;
+    }
+
+    Complex *row = malloc(g.w * sizeof(Complex));
+    Complex *outs[256] = { NULL };
+
+    // separable values from tables, so the points only multiply and add.
+    // Tables that overflow leave it to body to work them out point by point.
+    Wide *cols = NULL, *rows = NULL;
+    if (k.separable_count) {
+        cols = malloc((size_t)2 * k.separable_count * g.w * sizeof(Wide));
+        rows = malloc((size_t)2 * k.separable_count * g.h * sizeof(Wide));
+        if (!factor_tables(k, g, x0, y0, slots, cols, rows)) {
+            free(cols);
+            free(rows);
+            cols = rows = NULL;
+        }
+    }
+
+    Complex values[256];
+    for (unsigned int y = 0; y < g.h; ++y) {
+        for (unsigned int x = 0; x < g.w; ++x)
+            row[x] = (Complex){ g.origin.real + (x0 + x) * g.dx, g.origin.imag + (y0 + y) * g.dy };
+        outs[k.outputs - 1] = out + (size_t)y * g.w;
+        if (!cols) {
+            body(k, row, g.w, slots, outs);
+            continue;
+        }
+
+        for (unsigned int x = 0; x < g.w; ++x) {
+            for (unsigned int j = 0; j < k.separable_count; ++j) {
+                const Wide *c = cols + (size_t)2 * j * g.w + x, *r = rows + (size_t)2 * j * g.h + y;
+                Wide c1 = c[g.w], r1 = r[g.h];
+                double re = c->real * r->real - c->imag * r->imag + c1.real * r1.real - c1.imag * r1.imag;
+                double im = c->real * r->imag + c->imag * r->real + c1.real * r1.imag + c1.imag * r1.real;
+                slots[k.separable[j].slot] = (Complex){ (float)re, (float)im };
+            }
+            out[(size_t)y * g.w + x] = k.outputs == 1 ? run(k.body, row[x], slots)
+                                                      : (run_all(k.body, row[x], slots, values), values[k.outputs - 1]);
+        }
+    }
+    free(cols);
+    free(rows);
+    free(row);
+}
+
+void run_kernel_grid(Kernel k, Grid g, const Complex *params, Complex *out) {
+    run_kernel_window(k, g, 0, 0, g.w, g.h, params, out);
+}
+
+void run_batch_all(Bytecode bc, const Complex *zs, unsigned int n, const Complex *params, Complex **outs) {
+    if (n < HOIST_MIN_POINTS) {
+        Complex values[256];
+        for (unsigned int i = 0; i < n; ++i) {
+            unsigned int count = run_all(bc, zs[i], params, values);
+            for (unsigned int j = 0; j < count; ++j)
+                if (outs[j]) outs[j][i] = values[j];
+        }
+        return;
+    }
+
+    Kernel k = hoist(bc);
+    run_kernel(k, zs, n, params, outs);
+    free_kernel(&k);
+}
+
+void run_batch(Bytecode bc, const Complex *zs, unsigned int n, const Complex *params, Complex *out) {
+    if (n < HOIST_MIN_POINTS) {
+        for (unsigned int i = 0; i < n; ++i)
+            out[i] = run(bc, zs[i], params);
+        return;
+    }
+
+    Kernel k = hoist(bc);
+    Complex *outs[256] = { NULL };
+    outs[k.outputs - 1] = out;
+    run_kernel(k, zs, n, params, outs);
+    free_kernel(&k);
+}
+
+void run_grid(Bytecode bc, Grid g, const Complex *params, Complex *out) {
+    Kernel k = hoist(bc);
+    run_kernel_grid(k, g, params, out);
+    free_kernel(&k);
+}
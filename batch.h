@@ -0,0 +1,67 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "backend.h"
+
+#define MAX_SEPARABLE 16
+
+// sin, cos or exp of alpha z + beta. On a Grid these split into a factor
+// per column times a factor per row.
+typedef struct Separable {
+    Opcode op;                 // OP_SIN, OP_COS, or OP_POW for exp
+    unsigned char alpha, beta; // slots the prologue fills
+    unsigned char slot;        // the body reads the value here, per point
+} Separable;
+
+// A program split for evaluation over many points. Subexpressions that
+// don't depend on z are computed once per batch by the prologue and read
+// back by the body as parameters params[first_slot...]. So are the
+// separable ones, which need filling in for each point.
+typedef struct Kernel {
+    Bytecode prologue; // leaves one value per hoisted subexpression, alpha and beta per separable one, then coefficients
+    Bytecode body;     // evaluated per point
+    unsigned int first_slot;
+    unsigned int hoisted;
+    unsigned int outputs;
+    Separable separable[MAX_SEPARABLE];
+    unsigned int separable_count;
+    unsigned int degree;        // of the last output as a polynomial in z, 0 if it isn't one
+    unsigned char coefficients; // slot of its constant term, the prologue fills degree + 1 of them
+
+    // The last output again if it's a polynomial of high degree with constant
+    // coefficients, apart from the constant term, which goes in a slot
+    Complex *table; // lowest first, table[0] unused
+    unsigned int table_degree;
+    unsigned char constant_term;
+} Kernel;
+
+Kernel hoist(Bytecode bc);
+void free_kernel(Kernel *k);
+// Parameters followed by the hoisted values, for kernel_point
+void kernel_slots(Kernel k, const Complex *params, Complex *slots);
+// The last output at z. Fills in the separable values, then runs k.body.
+Complex kernel_point(Kernel k, Complex z, Complex *slots);
+// outs[k][i] gets output k at zs[i]. Outputs with a NULL array are skipped.
+void run_kernel(Kernel k, const Complex *zs, unsigned int n, const Complex *params, Complex **outs);
+
+// Evaluate at every point of zs. Hoists loop invariants for large batches.
+// High degree polynomials at points equally spaced around a circle go by FFT instead.
+void run_batch(Bytecode bc, const Complex *zs, unsigned int n, const Complex *params, Complex *out); // last output only
+void run_batch_all(Bytecode bc, const Complex *zs, unsigned int n, const Complex *params, Complex **outs);
+
+// Axis-aligned lattice: point (x, y) is origin + x*dx + i*y*dy
+typedef struct Grid {
+    Complex origin;
+    float dx, dy;
+    unsigned int w, h;
+} Grid;
+
+// Evaluate the last output at every lattice point, row-major into out
+void run_grid(Bytecode bc, Grid g, const Complex *params, Complex *out);
+void run_kernel_grid(Kernel k, Grid g, const Complex *params, Complex *out);
+// Just the w by h window of g from lattice point (x0, y0). Points are worked
+// out from their index in g, so windows sharing an edge agree on it exactly.
+void run_kernel_window(Kernel k, Grid g, unsigned int x0, unsigned int y0, unsigned int w, unsigned int h,
+                       const Complex *params, Complex *out);
+
+#endif
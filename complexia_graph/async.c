@@ -0,0 +1,111 @@
+#include "async.h"
+#include <pthread.h>
+
+typedef struct Request {
+    Bytecode bc; // our own copy
+    Complex params[MAX_PARAMS];
+    bool has_params;
+    View view;
+    unsigned int width, height;
+    float square_size;
+    unsigned int generation;
+} Request;
+
+struct AsyncRender {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    atomic_uint generation; // of the newest request
+    bool quit;
+
+    // everything below is guarded by lock
+    Request pending;
+    bool has_pending;
+    Contours done;
+    View done_view;
+    bool fresh; // done hasn't been taken yet
+};
+
+static void *async_main(void *arg) {
+    AsyncRender *a = arg;
+    Contours working = { 0 };
+
+    pthread_mutex_lock(&a->lock);
+    while (true) {
+        while (!a->has_pending && !a->quit) pthread_cond_wait(&a->wake, &a->lock);
+        if (a->quit) break;
+        Request r = a->pending;
+        a->has_pending = false;
+        pthread_mutex_unlock(&a->lock);
+
+        bool finished = contour_cancellable(r.bc, r.has_params ? r.params : NULL, r.view, r.width, r.height,
+                                            r.square_size, &a->generation, r.generation, &working);
+        free(r.bc.data);
+
+        pthread_mutex_lock(&a->lock);
+        if (finished && atomic_load(&a->generation) == r.generation) {
+            Contours t = a->done;
+            a->done = working;
+            working = t;
+            a->done_view = r.view;
+            a->fresh = true;
+        }
+    }
+    pthread_mutex_unlock(&a->lock);
+    free_contours(&working);
+    return NULL;
+}
+
+AsyncRender *async_create(void) {
+    AsyncRender *a = calloc(1, sizeof(AsyncRender));
+    pthread_mutex_init(&a->lock, NULL);
+    pthread_cond_init(&a->wake, NULL);
+    atomic_init(&a->generation, 0);
+    pthread_create(&a->thread, NULL, async_main, a);
+    return a;
+}
+
+void async_destroy(AsyncRender *a) {
+    pthread_mutex_lock(&a->lock);
+    a->quit = true;
+    atomic_fetch_add(&a->generation, 1); // cancels whatever is running
+    pthread_cond_signal(&a->wake);
+    pthread_mutex_unlock(&a->lock);
+    pthread_join(a->thread, NULL);
+
+    if (a->has_pending) free(a->pending.bc.data);
+    free_contours(&a->done);
+    pthread_mutex_destroy(&a->lock);
+    pthread_cond_destroy(&a->wake);
+    free(a);
+}
+
+unsigned int async_request(AsyncRender *a, Bytecode bc, const Complex *params, View view,
+                           unsigned int width, unsigned int height, float square_size) {
+    Bytecode copy = { bc.length, malloc(bc.length) };
+    memcpy(copy.data, bc.data, bc.length);
+
+    pthread_mutex_lock(&a->lock);
+    if (a->has_pending) free(a->pending.bc.data);
+    unsigned int generation = atomic_fetch_add(&a->generation, 1) + 1;
+    a->pending = (Request){ copy, { { 0 } }, params != NULL, view, width, height, square_size, generation };
+    if (params) memcpy(a->pending.params, params, sizeof(a->pending.params));
+    a->has_pending = true;
+    pthread_cond_signal(&a->wake);
+    pthread_mutex_unlock(&a->lock);
+    return generation;
+}
+
+bool async_take(AsyncRender *a, Contours *out, View *view) {
+    pthread_mutex_lock(&a->lock);
+    bool fresh = a->fresh;
+    if (fresh) {
+        Contours t = *out;
+        *out = a->done;
+        a->done = t;
+        *view = a->done_view;
+        a->fresh = false;
+    }
+    pthread_mutex_unlock(&a->lock);
+    return fresh;
+}
@@ -0,0 +1,22 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include "contour.h"
+
+// Contouring on a background thread. Every request gets a new generation,
+// and tiles still being worked on for an older one are dropped, so a burst
+// of requests only costs the last one plus a little.
+typedef struct AsyncRender AsyncRender;
+
+AsyncRender *async_create(void);
+void async_destroy(AsyncRender *a);
+// Replaces whatever was asked for before. bc and params are copied, params
+// can be NULL. Returns the request's generation.
+unsigned int async_request(AsyncRender *a, Bytecode bc, const Complex *params, View view,
+                           unsigned int width, unsigned int height, float square_size);
+// If a request has finished since the last take, swap its contours into
+// *out, set *view to the view it was for and return true. out has to be a
+// Contours that's only used with this, since its buffers get recycled.
+bool async_take(AsyncRender *a, Contours *out, View *view);
+
+#endif
@@ -0,0 +1,133 @@
+#include "coloring.h"
+#include "../batch.h"
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+
+#define PI 3.14159265358979323846
+#define TILE_PIXELS 64  // per tile side
+#define HUE_STEPS 256   // per octant
+#define LOG_STEPS 1024  // over the mantissa of |f|^2
+#define SHADE_STEPS 256 // over one doubling of |f|
+
+// Hue by octant and by the ratio of the smaller to the larger of |Re| and |Im|,
+// so finding it takes a division instead of an atan2 and an HSV conversion
+static uint32_t hues[8][HUE_STEPS + 1];
+// log2 of mantissas in [0.5, 1)
+static float logs[LOG_STEPS + 1];
+// Brightness multiplier out of 256, by how far log2 |f| is through its doubling
+static uint32_t shades[SHADE_STEPS];
+
+static uint32_t hue_color(double angle) {
+    double h = angle / (2 * PI);
+    h = (h - floor(h)) * 6;
+    double f = h - floor(h);
+    double r, g, b;
+    switch ((int)h % 6) {
+        case 0:  r = 1;     g = f;     b = 0;     break;
+        case 1:  r = 1 - f; g = 1;     b = 0;     break;
+        case 2:  r = 0;     g = 1;     b = f;     break;
+        case 3:  r = 0;     g = 1 - f; b = 1;     break;
+        case 4:  r = f;     g = 0;     b = 1;     break;
+        default: r = 1;     g = 0;     b = 1 - f; break;
+    }
+    return (uint32_t)lround(r * 255) << 16 | (uint32_t)lround(g * 255) << 8 | (uint32_t)lround(b * 255);
+}
+
+static void fill_tables(void) {
+    for (unsigned int o = 0; o < 8; ++o) {
+        // octant bits: 4 is Re < 0, 2 is Im < 0, 1 is |Im| > |Re|
+        double sx = o & 4 ? -1 : 1, sy = o & 2 ? -1 : 1;
+        for (unsigned int i = 0; i <= HUE_STEPS; ++i) {
+            double t = (double)i / HUE_STEPS;
+            hues[o][i] = o & 1 ? hue_color(atan2(sy, sx * t)) : hue_color(atan2(sy * t, sx));
+        }
+    }
+    for (unsigned int i = 0; i <= LOG_STEPS; ++i) logs[i] = (float)log2(0.5 + 0.5 * i / LOG_STEPS);
+    for (unsigned int i = 0; i < SHADE_STEPS; ++i) shades[i] = (uint32_t)(256 * (0.6 + 0.4 * i / SHADE_STEPS));
+}
+
+static void build_tables(void) {
+    static pthread_once_t built = PTHREAD_ONCE_INIT;
+    pthread_once(&built, fill_tables);
+}
+
+static uint32_t color(Complex w) {
+    float x = w.real, y = w.imag;
+    if (!isfinite(x) || !isfinite(y)) return 0xffffffff;
+    float ax = fabsf(x), ay = fabsf(y);
+    if (ax == 0 && ay == 0) return 0xff000000;
+
+    unsigned int octant = (x < 0) << 2 | (y < 0) << 1 | (ay > ax);
+    float t = ay > ax ? ax / ay : ay / ax;
+    uint32_t hue = hues[octant][(unsigned int)(t * HUE_STEPS + 0.5f)];
+
+    // log2 |f| = (e + log2 m) / 2 with |f|^2 = m 2^e, rescaled if |f|^2 overflows
+    // or underflows. 2^100 brings even the smallest denormal back to normal squares
+    float m2 = x * x + y * y;
+    int offset = 0;
+    if (isinf(m2)) {
+        x *= 0x1p-64f;
+        y *= 0x1p-64f;
+        m2 = x * x + y * y;
+        offset = 128;
+    } else if (m2 < FLT_MIN) {
+        x *= 0x1p100f;
+        y *= 0x1p100f;
+        m2 = x * x + y * y;
+        offset = -200;
+    }
+    int e;
+    float m = frexpf(m2, &e);
+    float l = 0.5f * (e + offset + logs[(unsigned int)((m - 0.5f) * 2 * LOG_STEPS)]);
+    uint32_t shade = shades[(unsigned int)((l - floorf(l)) * SHADE_STEPS) % SHADE_STEPS];
+
+    uint32_t r = (hue >> 16 & 0xff) * shade >> 8, g = (hue >> 8 & 0xff) * shade >> 8, b = (hue & 0xff) * shade >> 8;
+    return 0xff000000 | r << 16 | g << 8 | b;
+}
+
+typedef struct Picture {
+    Kernel k;
+    const Complex *params;
+    Grid g; // pixel centers
+    unsigned int tiles_x;
+    uint32_t *pixels;
+    unsigned int pitch;
+} Picture;
+
+static void color_tile(void *arg, unsigned int index, unsigned int worker) {
+    Picture *p = arg;
+    unsigned int x0 = index % p->tiles_x * TILE_PIXELS, y0 = index / p->tiles_x * TILE_PIXELS;
+    unsigned int w = p->g.w - x0 < TILE_PIXELS ? p->g.w - x0 : TILE_PIXELS;
+    unsigned int h = p->g.h - y0 < TILE_PIXELS ? p->g.h - y0 : TILE_PIXELS;
+
+    Grid g = { { p->g.origin.real + x0 * p->g.dx, p->g.origin.imag + y0 * p->g.dy }, p->g.dx, p->g.dy, w, h };
+    Complex values[TILE_PIXELS * TILE_PIXELS];
+    run_kernel_grid(p->k, g, p->params, values);
+
+    for (unsigned int y = 0; y < h; ++y) {
+        uint32_t *row = (uint32_t *)((char *)p->pixels + (size_t)(y0 + y) * p->pitch) + x0;
+        for (unsigned int x = 0; x < w; ++x) row[x] = color(values[y * w + x]);
+    }
+}
+
+void color_pixels(Bytecode bc, const Complex *params, View view, unsigned int width, unsigned int height,
+                  uint32_t *pixels, unsigned int pitch) {
+    if (!width || !height) return;
+    build_tables();
+
+    Picture p;
+    p.k = hoist(bc);
+    p.params = params;
+    p.g = (Grid){
+        { view.center.real + (0.5f - width / 2.0f) * view.scale, view.center.imag - (0.5f - height / 2.0f) * view.scale },
+        view.scale, -view.scale, width, height
+    };
+    p.tiles_x = (width + TILE_PIXELS - 1) / TILE_PIXELS;
+    p.pixels = pixels;
+    p.pitch = pitch;
+    unsigned int tiles_y = (height + TILE_PIXELS - 1) / TILE_PIXELS;
+
+    pool_run(render_pool(), color_tile, &p, p.tiles_x * tiles_y);
+    free_kernel(&p.k);
+}
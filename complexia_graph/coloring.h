@@ -0,0 +1,14 @@
+#ifndef COLORING_H
+#define COLORING_H
+
+#include "contour.h"
+#include <stdint.h>
+
+// Domain colouring: the hue follows arg f(z), and the brightness cycles once
+// every time |f(z)| doubles. Zeros are black, infinities and NaNs white.
+// Each pixel shows f at its center. Pixels are 0xAARRGGBB, which is
+// SDL_PIXELFORMAT_ARGB8888, and rows are pitch bytes apart.
+void color_pixels(Bytecode bc, const Complex *params, View view, unsigned int width, unsigned int height,
+                  uint32_t *pixels, unsigned int pitch);
+
+#endif
@@ -0,0 +1,338 @@
+#include "contour.h"
+#include "../batch.h"
+#include "../interval.h"
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+
+float eval_at(Bytecode bc, Complex pos, const Complex *params) {
+    return run(bc, pos, params).real;
+}
+
+// Square edges, clockwise from the top
+enum { EDGE_TOP, EDGE_RIGHT, EDGE_BOTTOM, EDGE_LEFT };
+
+// Edge pairs crossed by the contour, indexed by which corners are positive:
+// bit 3 top left, bit 2 top right, bit 1 bottom right, bit 0 bottom left.
+// The two saddles (5 and 10) are resolved separately.
+static const signed char segments[16][4] = {
+    { -1 },
+    { EDGE_LEFT, EDGE_BOTTOM, -1 },
+    { EDGE_BOTTOM, EDGE_RIGHT, -1 },
+    { EDGE_LEFT, EDGE_RIGHT, -1 },
+    { EDGE_TOP, EDGE_RIGHT, -1 },
+    { -1 },
+    { EDGE_TOP, EDGE_BOTTOM, -1 },
+    { EDGE_TOP, EDGE_LEFT, -1 },
+    { EDGE_TOP, EDGE_LEFT, -1 },
+    { EDGE_TOP, EDGE_BOTTOM, -1 },
+    { -1 },
+    { EDGE_TOP, EDGE_RIGHT, -1 },
+    { EDGE_LEFT, EDGE_RIGHT, -1 },
+    { EDGE_BOTTOM, EDGE_RIGHT, -1 },
+    { EDGE_LEFT, EDGE_BOTTOM, -1 },
+    { -1 },
+};
+
+// Lattice edges have one key each: horizontal edges from corner (x, y) are
+// 2 * (y * cols + x), vertical ones the next number up.
+static unsigned int edge_key(int edge, unsigned int x, unsigned int y, unsigned int cols) {
+    switch (edge) {
+        case EDGE_TOP:    return 2 * (y * cols + x);
+        case EDGE_RIGHT:  return 2 * (y * cols + x + 1) + 1;
+        case EDGE_BOTTOM: return 2 * ((y + 1) * cols + x);
+        default:          return 2 * (y * cols + x) + 1;
+    }
+}
+
+// Where the contour crosses an edge, interpolated linearly between its corners
+static void edge_point(int edge, float x, float y, float s, const float v[4], float *px, float *py) {
+    float a = v[edge], b = v[(edge + 1) & 3]; // corners are tl, tr, br, bl
+    float t = a / (a - b);
+    switch (edge) {
+        case EDGE_TOP:    *px = x + s * t;       *py = y;               break;
+        case EDGE_RIGHT:  *px = x + s;           *py = y + s * t;       break;
+        case EDGE_BOTTOM: *px = x + s * (1 - t); *py = y + s;           break;
+        case EDGE_LEFT:   *px = x;               *py = y + s * (1 - t); break;
+    }
+}
+
+unsigned int march_square(unsigned int x, unsigned int y, unsigned int cols, float s, const float v[4], Line *out) {
+    unsigned int c = (v[0] > 0) << 3 | (v[1] > 0) << 2 | (v[2] > 0) << 1 | (v[3] > 0);
+    signed char pairs[4];
+
+    if (c == 5 || c == 10) {
+        // saddle: the average decides which diagonal corners are connected
+        bool center = (v[0] + v[1] + v[2] + v[3]) > 0;
+        bool cut_tl = (c == 5) == center;
+        if (cut_tl) memcpy(pairs, (signed char[]){ EDGE_TOP, EDGE_LEFT, EDGE_BOTTOM, EDGE_RIGHT }, 4);
+        else        memcpy(pairs, (signed char[]){ EDGE_TOP, EDGE_RIGHT, EDGE_LEFT, EDGE_BOTTOM }, 4);
+    } else {
+        memcpy(pairs, segments[c], 4);
+    }
+
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < 4 && pairs[i] >= 0; i += 2, ++n) {
+        edge_point(pairs[i],     x * s, y * s, s, v, &out[n].x0, &out[n].y0);
+        edge_point(pairs[i + 1], x * s, y * s, s, v, &out[n].x1, &out[n].y1);
+        out[n].e0 = edge_key(pairs[i],     x, y, cols);
+        out[n].e1 = edge_key(pairs[i + 1], x, y, cols);
+    }
+    return n;
+}
+
+typedef struct Frame {
+    Kernel k;
+    const Complex *params;
+    Grid g; // the whole corner lattice
+    float square_size;
+    unsigned int tiles_x;
+    unsigned int first; // tile the pool's indices count from
+    LineBuffer *found; // one per worker, only appended to by that worker
+
+    bool adaptive;
+    float variation;
+    const atomic_uint *generation; // stop once this isn't wanted any more, NULL to never stop
+    unsigned int wanted;
+    Complex slots[MAX_PARAMS]; // for kernel_point and kernel_box
+} Frame;
+
+bool grid_contour_free(Kernel k, const Complex *slots, Grid g) {
+    float x0 = g.origin.real, x1 = g.origin.real + (g.w - 1) * g.dx;
+    float y0 = g.origin.imag, y1 = g.origin.imag + (g.h - 1) * g.dy;
+    // the corners get sampled at slightly differently rounded points, so keep a margin
+    float px = fabsf(g.dx) / 1024, py = fabsf(g.dy) / 1024;
+    Box cell = { { fminf(x0, x1) - px, fmaxf(x0, x1) + px }, { fminf(y0, y1) - py, fmaxf(y0, y1) + py } };
+    Interval re = kernel_box(k, cell, slots).real;
+    // march counts a corner as positive when it's > 0
+    return re.lo > 0 || re.hi <= 0;
+}
+
+// The size by size block of squares at lattice corner (x, y)
+static bool no_crossing(Frame *f, unsigned int x, unsigned int y, unsigned int size) {
+    Grid g = f->g;
+    Grid block = { { g.origin.real + x * g.dx, g.origin.imag + y * g.dy }, g.dx, g.dy, size + 1, size + 1 };
+    return grid_contour_free(f->k, f->slots, block);
+}
+
+void march_values(const float *v, unsigned int w, unsigned int h, unsigned int x0, unsigned int y0,
+                  unsigned int cols, float square_size, LineBuffer *out) {
+    for (unsigned int y = 0; y + 1 < h; ++y) {
+        for (unsigned int x = 0; x + 1 < w; ++x) {
+            const float *top = v + y * w + x, *bottom = top + w;
+            float corners[4] = { top[0], top[1], bottom[1], bottom[0] };
+
+            Line lines[2];
+            unsigned int n = march_square(x0 + x, y0 + y, cols, square_size, corners, lines);
+            for (unsigned int i = 0; i < n; ++i) push_line(out, lines[i]);
+        }
+    }
+}
+
+void march_grid(Kernel k, const Complex *params, Grid g, unsigned int x0, unsigned int y0, unsigned int w,
+                unsigned int h, float square_size, LineBuffer *out) {
+    Complex values[(TILE_SQUARES + 1) * (TILE_SQUARES + 1)];
+    float v[(TILE_SQUARES + 1) * (TILE_SQUARES + 1)];
+    run_kernel_window(k, g, x0, y0, w, h, params, values);
+    for (unsigned int i = 0; i < w * h; ++i) v[i] = values[i].real;
+    march_values(v, w, h, x0, y0, g.w, square_size, out);
+}
+
+// Corners of one tile, evaluated on demand
+typedef struct TileCorners {
+    Frame *f;
+    unsigned int x0, y0, cols, rows;
+    float v[(TILE_SQUARES + 1) * (TILE_SQUARES + 1)];
+    bool known[(TILE_SQUARES + 1) * (TILE_SQUARES + 1)];
+    Complex slots[MAX_PARAMS]; // the frame's, which kernel_point writes separable values into
+} TileCorners;
+
+static float corner(TileCorners *c, unsigned int x, unsigned int y) {
+    unsigned int i = y * (TILE_SQUARES + 1) + x;
+    if (!c->known[i]) {
+        Grid g = c->f->g;
+        Complex z = { g.origin.real + (c->x0 + x) * g.dx, g.origin.imag + (c->y0 + y) * g.dy };
+        c->v[i] = kernel_point(c->f->k, z, c->slots).real;
+        c->known[i] = true;
+    }
+    return c->v[i];
+}
+
+// Split a cell of size squares until it's one square, unless interval
+// arithmetic rules out a crossing, or its corners and center all have the
+// same sign and vary by less than the frame's threshold.
+static void refine(TileCorners *c, unsigned int x, unsigned int y, unsigned int size, LineBuffer *found) {
+    if (x + 1 >= c->cols || y + 1 >= c->rows) return;
+    if (no_crossing(c->f, c->x0 + x, c->y0 + y, size)) return;
+
+    if (size == 1) {
+        float v[4] = { corner(c, x, y), corner(c, x + 1, y), corner(c, x + 1, y + 1), corner(c, x, y + 1) };
+        Line lines[2];
+        unsigned int n = march_square(c->x0 + x, c->y0 + y, c->f->g.w, c->f->square_size, v, lines);
+        for (unsigned int i = 0; i < n; ++i) push_line(found, lines[i]);
+        return;
+    }
+
+    unsigned int half = size / 2;
+    // cells hanging off the edge of the lattice always get split
+    if (x + size < c->cols && y + size < c->rows) {
+        float v[5] = {
+            corner(c, x, y), corner(c, x + size, y), corner(c, x + size, y + size), corner(c, x, y + size),
+            corner(c, x + half, y + half)
+        };
+        float lo = v[0], hi = v[0];
+        bool nan = false;
+        for (unsigned int i = 0; i < 5; ++i) {
+            lo = v[i] < lo ? v[i] : lo;
+            hi = v[i] > hi ? v[i] : hi;
+            nan = nan || isnan(v[i]);
+        }
+        bool crosses = lo <= 0 && hi > 0;
+        if (!nan && !crosses && hi - lo <= c->f->variation) return;
+    }
+
+    refine(c, x,        y,        half, found);
+    refine(c, x + half, y,        half, found);
+    refine(c, x,        y + half, half, found);
+    refine(c, x + half, y + half, half, found);
+}
+
+// Evaluate one tile's corners and march its squares
+static void render_tile(void *arg, unsigned int index, unsigned int worker) {
+    Frame *f = arg;
+    unsigned int tile = f->first + index;
+    unsigned int x0 = tile % f->tiles_x * TILE_SQUARES, y0 = tile / f->tiles_x * TILE_SQUARES;
+    unsigned int cols = f->g.w - x0 < TILE_SQUARES + 1 ? f->g.w - x0 : TILE_SQUARES + 1;
+    unsigned int rows = f->g.h - y0 < TILE_SQUARES + 1 ? f->g.h - y0 : TILE_SQUARES + 1;
+    if (f->generation && atomic_load(f->generation) != f->wanted) return;
+
+    if (f->adaptive) {
+        // the tile is the root of a quadtree
+        TileCorners c;
+        c.f = f;
+        c.x0 = x0;
+        c.y0 = y0;
+        c.cols = cols;
+        c.rows = rows;
+        memset(c.known, 0, sizeof(c.known));
+        memcpy(c.slots, f->slots, sizeof(c.slots));
+        refine(&c, 0, 0, TILE_SQUARES, &f->found[worker]);
+        return;
+    }
+    if (no_crossing(f, x0, y0, TILE_SQUARES)) return;
+
+    // tiles share their border corners with their neighbours
+    march_grid(f->k, f->params, f->g, x0, y0, cols, rows, f->square_size, &f->found[worker]);
+}
+
+void free_contours(Contours *c) {
+    for (unsigned int w = 0; w < c->workers; ++w) free_lines(&c->found[w]);
+    free(c->found);
+    free_lines(&c->lines);
+    free_polylines(&c->polylines);
+    *c = (Contours){ 0 };
+}
+
+static Pool *shared_pool = NULL;
+
+static void start_pool(void) {
+    shared_pool = pool_create(0);
+}
+
+Pool *render_pool(void) {
+    static pthread_once_t started = PTHREAD_ONCE_INIT;
+    pthread_once(&started, start_pool);
+    return shared_pool;
+}
+
+static double seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// With next_tile, carries on from there a batch of tiles at a time until
+// budget seconds have gone, and false if that wasn't all of them.
+static bool contour_frame(Bytecode bc, const Complex *params, View view, unsigned int width, unsigned int height,
+                          float square_size, bool adaptive, float variation,
+                          const atomic_uint *generation, unsigned int wanted,
+                          unsigned int *next_tile, float budget, Contours *out) {
+    double start = seconds();
+    unsigned int squares_x = (unsigned int)ceilf(width / square_size);
+    unsigned int squares_y = (unsigned int)ceilf(height / square_size);
+
+    // each tile evaluates its own corners once and marches its squares on some worker
+    Pool *pool = render_pool();
+    Frame f;
+    f.k = hoist(bc);
+    f.params = params;
+    f.g = (Grid){
+        { view.center.real - width / 2.0f * view.scale, view.center.imag + height / 2.0f * view.scale },
+        square_size * view.scale, -square_size * view.scale,
+        squares_x + 1, squares_y + 1
+    };
+    f.square_size = square_size;
+    f.adaptive = adaptive;
+    f.variation = variation;
+    f.generation = generation;
+    f.wanted = wanted;
+    kernel_slots(f.k, params, f.slots);
+    f.tiles_x = (squares_x + TILE_SQUARES - 1) / TILE_SQUARES;
+    unsigned int tiles_y = (squares_y + TILE_SQUARES - 1) / TILE_SQUARES;
+    if (out->workers != pool_size(pool)) {
+        for (unsigned int w = 0; w < out->workers; ++w) free_lines(&out->found[w]);
+        free(out->found);
+        out->found = calloc(pool_size(pool), sizeof(LineBuffer));
+        out->workers = pool_size(pool);
+    }
+    unsigned int tiles = f.tiles_x * tiles_y;
+    f.first = next_tile ? *next_tile : 0;
+    if (!f.first)
+        for (unsigned int w = 0; w < out->workers; ++w) out->found[w].count = 0;
+    f.found = out->found;
+
+    if (!next_tile) {
+        pool_run(pool, render_tile, &f, tiles);
+        f.first = tiles;
+    } else {
+        // at least one batch, so every call gets somewhere
+        unsigned int batch = 2 * pool_size(pool);
+        do {
+            unsigned int n = tiles - f.first < batch ? tiles - f.first : batch;
+            pool_run(pool, render_tile, &f, n);
+            f.first += n;
+        } while (f.first < tiles && seconds() - start < budget);
+        *next_tile = f.first;
+    }
+    free_kernel(&f.k);
+    if (generation && atomic_load(generation) != wanted) return false;
+    if (f.first < tiles) return false;
+
+    out->lines.count = 0;
+    for (unsigned int w = 0; w < out->workers; ++w)
+        append_lines(&out->lines, out->found[w].lines, out->found[w].count);
+
+    stitch(out->lines.lines, out->lines.count, &out->polylines);
+    simplify(&out->polylines, SIMPLIFY_TOLERANCE);
+    return true;
+}
+
+void contour(Bytecode bc, const Complex *params, View view, unsigned int width, unsigned int height,
+             float square_size, Contours *out) {
+    contour_frame(bc, params, view, width, height, square_size, false, 0.0f, NULL, 0, NULL, 0.0f, out);
+}
+
+bool contour_budgeted(Bytecode bc, const Complex *params, View view, unsigned int width, unsigned int height,
+                      float square_size, float budget, unsigned int *next_tile, Contours *out) {
+    return contour_frame(bc, params, view, width, height, square_size, false, 0.0f, NULL, 0, next_tile, budget, out);
+}
+
+bool contour_cancellable(Bytecode bc, const Complex *params, View view, unsigned int width, unsigned int height,
+                         float square_size, const atomic_uint *generation, unsigned int wanted, Contours *out) {
+    return contour_frame(bc, params, view, width, height, square_size, false, 0.0f, generation, wanted, NULL, 0.0f, out);
+}
+
+void contour_adaptive(Bytecode bc, const Complex *params, View view, unsigned int width, unsigned int height,
+                      float min_square, float variation, Contours *out) {
+    contour_frame(bc, params, view, width, height, min_square, true, variation, NULL, 0, NULL, 0.0f, out);
+}
@@ -0,0 +1,76 @@
+#ifndef CONTOUR_H
+#define CONTOUR_H
+
+#include "../backend.h"
+#include "../pool.h"
+#include "../batch.h"
+#include "lines.h"
+#include <stdatomic.h>
+
+#define SIMPLIFY_TOLERANCE 0.5f // pixels
+#define TILE_SQUARES 32 // squares per tile side
+
+// What part of the plane is on screen
+typedef struct View {
+    Complex center;
+    float scale; // plane units per pixel
+} View;
+
+// Everything one contour pass produces, in pixel coordinates. Start it
+// zeroed and keep it between frames, so a steady view doesn't allocate.
+typedef struct Contours {
+    LineBuffer lines;    // marched segments
+    Polylines polylines; // the segments stitched and simplified
+    LineBuffer *found;   // per worker, while marching
+    unsigned int workers;
+} Contours;
+
+void free_contours(Contours *c);
+
+// Workers shared by the renderers, started on first use
+Pool *render_pool(void);
+
+float eval_at(Bytecode bc, Complex pos, const Complex *params);
+// Marching squares over the zero set of Re(f) on a width by height pixel
+// view. Tiles that interval arithmetic proves contour free are skipped.
+void contour(Bytecode bc, const Complex *params, View view, unsigned int width, unsigned int height,
+             float square_size, Contours *out);
+// Same, but giving up between tiles once *generation stops being wanted.
+// False if it gave up, leaving out's contours as they were.
+bool contour_cancellable(Bytecode bc, const Complex *params, View view, unsigned int width, unsigned int height,
+                         float square_size, const atomic_uint *generation, unsigned int wanted, Contours *out);
+// Same, but a few tiles at a time from *next_tile (0 to start over), stopping
+// between them once budget seconds have gone. True once the last tile is
+// done and out's contours are complete. Until then they're left as they
+// were, and the tiles so far wait in out->found for the next call.
+bool contour_budgeted(Bytecode bc, const Complex *params, View view, unsigned int width, unsigned int height,
+                      float square_size, float budget, unsigned int *next_tile, Contours *out);
+// Like contour, but starting from coarse cells that are only split where the
+// contour might be: where interval arithmetic can't rule it out, and the
+// signs of Re(f) at their corners and center differ or vary by more than
+// variation. Contours come out of min_square sized cells, like contour at
+// that size. With variation 0 practically only provably empty cells are
+// skipped, so thin features aren't lost between samples.
+void contour_adaptive(Bytecode bc, const Complex *params, View view, unsigned int width, unsigned int height,
+                      float min_square, float variation, Contours *out);
+
+// Building blocks for renderers that manage their own tiles.
+// Contour segments through square (x, y) of a lattice cols corners wide,
+// at most two. v holds its corners as top left, top right, bottom right,
+// bottom left, and the contour is where they'd cross 0.
+unsigned int march_square(unsigned int x, unsigned int y, unsigned int cols, float square_size, const float v[4], Line *out);
+// March a w by h block of corner values of Re(f), row-major, as if its
+// corner (0, 0) were corner (x0, y0) of a lattice cols corners wide drawn
+// with square_size pixel squares.
+void march_values(const float *v, unsigned int w, unsigned int h, unsigned int x0, unsigned int y0,
+                  unsigned int cols, float square_size, LineBuffer *out);
+// Same, evaluating the w by h corners of lattice g from (x0, y0) first,
+// each from its index in g so neighbouring blocks agree on shared corners.
+// At most TILE_SQUARES squares a side.
+void march_grid(Kernel k, const Complex *params, Grid g, unsigned int x0, unsigned int y0, unsigned int w,
+                unsigned int h, float square_size, LineBuffer *out);
+// True when interval arithmetic proves Re(f) keeps one sign over the whole
+// lattice, so no contour can pass through it. slots as from kernel_slots.
+bool grid_contour_free(Kernel k, const Complex *slots, Grid g);
+
+#endif
@@ -0,0 +1,160 @@
+#include "levels.h"
+#include <math.h>
+
+#define PI 3.14159265358979323846f
+
+typedef struct LevelFrame {
+    Kernel k;
+    const Complex *params;
+    Grid g;
+    float square_size;
+    unsigned int tiles_x;
+    LevelField field;
+    const float *levels;
+    unsigned int count;
+    float *cos_levels, *sin_levels; // for LEVEL_ARG
+    Contours *out;
+} LevelFrame;
+
+// First level that isn't below x
+static unsigned int lower_bound(const float *levels, unsigned int count, float x) {
+    unsigned int lo = 0, hi = count;
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+        if (levels[mid] < x) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void march_level(LevelFrame *f, unsigned int k, unsigned int x, unsigned int y, const float v[4], unsigned int worker) {
+    Line lines[2];
+    unsigned int n = march_square(x, y, f->g.w, f->square_size, v, lines);
+    for (unsigned int i = 0; i < n; ++i) push_line(&f->out[k].found[worker], lines[i]);
+}
+
+// Levels of |f| or Re(f): the square straddles every level in [lowest corner, highest corner)
+static void scalar_square(LevelFrame *f, unsigned int x, unsigned int y, const float q[4], unsigned int worker) {
+    float lo = fminf(fminf(q[0], q[1]), fminf(q[2], q[3])), hi = fmaxf(fmaxf(q[0], q[1]), fmaxf(q[2], q[3]));
+    for (unsigned int k = lower_bound(f->levels, f->count, lo); k < f->count && f->levels[k] < hi; ++k) {
+        float v[4] = { q[0] - f->levels[k], q[1] - f->levels[k], q[2] - f->levels[k], q[3] - f->levels[k] };
+        march_level(f, k, x, y, v, worker);
+    }
+}
+
+// Levels of arg f: rotating f by -level puts the ray on the positive real
+// axis, where Im crosses 0 and Re is positive
+static void arg_square(LevelFrame *f, unsigned int x, unsigned int y, const Complex w[4], unsigned int worker) {
+    // the corners' arguments, unwrapped around the first one
+    float a0 = atan2f(w[0].imag, w[0].real), lo = a0, hi = a0;
+    for (unsigned int i = 1; i < 4; ++i) {
+        float d = atan2f(w[i].imag, w[i].real) - a0;
+        d -= 2 * PI * roundf(d / (2 * PI));
+        lo = fminf(lo, a0 + d);
+        hi = fmaxf(hi, a0 + d);
+    }
+    bool everything = hi - lo >= PI || isnan(hi - lo); // around a zero or pole
+
+    for (unsigned int k = 0; k < f->count; ++k) {
+        if (!everything) {
+            float level = f->levels[k] + 2 * PI * roundf((lo - f->levels[k]) / (2 * PI));
+            if (level < lo) level += 2 * PI;
+            if (level > hi) continue;
+        }
+        float c = f->cos_levels[k], s = f->sin_levels[k];
+        float v[4], re = 0;
+        for (unsigned int i = 0; i < 4; ++i) {
+            v[i] = w[i].imag * c - w[i].real * s;
+            re += w[i].real * c + w[i].imag * s;
+        }
+        // otherwise it's the opposite ray, level + pi
+        if (re > 0) march_level(f, k, x, y, v, worker);
+    }
+}
+
+static void level_tile(void *arg, unsigned int index, unsigned int worker) {
+    LevelFrame *f = arg;
+    unsigned int x0 = index % f->tiles_x * TILE_SQUARES, y0 = index / f->tiles_x * TILE_SQUARES;
+    Grid g = {
+        { f->g.origin.real + x0 * f->g.dx, f->g.origin.imag + y0 * f->g.dy },
+        f->g.dx, f->g.dy,
+        f->g.w - x0 < TILE_SQUARES + 1 ? f->g.w - x0 : TILE_SQUARES + 1,
+        f->g.h - y0 < TILE_SQUARES + 1 ? f->g.h - y0 : TILE_SQUARES + 1
+    };
+    Complex values[(TILE_SQUARES + 1) * (TILE_SQUARES + 1)];
+    float q[(TILE_SQUARES + 1) * (TILE_SQUARES + 1)];
+    // from the frame's lattice, so corners shared with the next tile come out the same
+    run_kernel_window(f->k, f->g, x0, y0, g.w, g.h, f->params, values);
+    for (unsigned int i = 0; i < g.w * g.h; ++i)
+        q[i] = f->field == LEVEL_MODULUS ? sqrtf(values[i].real * values[i].real + values[i].imag * values[i].imag)
+                                         : values[i].real;
+
+    for (unsigned int y = 0; y + 1 < g.h; ++y) {
+        for (unsigned int x = 0; x + 1 < g.w; ++x) {
+            unsigned int tl = y * g.w + x, bl = tl + g.w;
+            if (f->field == LEVEL_ARG) {
+                Complex w[4] = { values[tl], values[tl + 1], values[bl + 1], values[bl] };
+                arg_square(f, x0 + x, y0 + y, w, worker);
+            } else {
+                float corners[4] = { q[tl], q[tl + 1], q[bl + 1], q[bl] };
+                scalar_square(f, x0 + x, y0 + y, corners, worker);
+            }
+        }
+    }
+}
+
+void contour_levels(Bytecode bc, const Complex *params, View view, unsigned int width, unsigned int height,
+                    float square_size, LevelField field, const float *levels, unsigned int count, Contours *out) {
+    if (!count) return;
+    unsigned int squares_x = (unsigned int)ceilf(width / square_size);
+    unsigned int squares_y = (unsigned int)ceilf(height / square_size);
+    Pool *pool = render_pool();
+
+    LevelFrame f;
+    f.k = hoist(bc);
+    f.params = params;
+    f.g = (Grid){
+        { view.center.real - width / 2.0f * view.scale, view.center.imag + height / 2.0f * view.scale },
+        square_size * view.scale, -square_size * view.scale,
+        squares_x + 1, squares_y + 1
+    };
+    f.square_size = square_size;
+    f.tiles_x = (squares_x + TILE_SQUARES - 1) / TILE_SQUARES;
+    f.field = field;
+    f.levels = levels;
+    f.count = count;
+    f.cos_levels = malloc(count * sizeof(float));
+    f.sin_levels = malloc(count * sizeof(float));
+    for (unsigned int k = 0; k < count; ++k) {
+        f.cos_levels[k] = cosf(levels[k]);
+        f.sin_levels[k] = sinf(levels[k]);
+    }
+    f.out = out;
+    unsigned int tiles_y = (squares_y + TILE_SQUARES - 1) / TILE_SQUARES;
+
+    // every level marches into its own per worker buffers
+    for (unsigned int k = 0; k < count; ++k) {
+        Contours *c = &out[k];
+        if (c->workers != pool_size(pool)) {
+            for (unsigned int w = 0; w < c->workers; ++w) free_lines(&c->found[w]);
+            free(c->found);
+            c->found = calloc(pool_size(pool), sizeof(LineBuffer));
+            c->workers = pool_size(pool);
+        }
+        for (unsigned int w = 0; w < c->workers; ++w) c->found[w].count = 0;
+    }
+
+    pool_run(pool, level_tile, &f, f.tiles_x * tiles_y);
+
+    for (unsigned int k = 0; k < count; ++k) {
+        Contours *c = &out[k];
+        c->lines.count = 0;
+        for (unsigned int w = 0; w < c->workers; ++w) append_lines(&c->lines, c->found[w].lines, c->found[w].count);
+        stitch(c->lines.lines, c->lines.count, &c->polylines);
+        simplify(&c->polylines, SIMPLIFY_TOLERANCE);
+    }
+
+    free(f.cos_levels);
+    free(f.sin_levels);
+    free_kernel(&f.k);
+}
@@ -0,0 +1,20 @@
+#ifndef LEVELS_H
+#define LEVELS_H
+
+#include "contour.h"
+
+// What gets contoured at each level
+typedef enum LevelField {
+    LEVEL_REAL,    // Re(f)
+    LEVEL_MODULUS, // |f|
+    LEVEL_ARG,     // arg f, in radians, as rays without the jump at -pi
+} LevelField;
+
+// out[k] gets the contours where field(f) equals levels[k], all from one
+// evaluation of the lattice. Each square is matched against all levels at
+// once, and only marched for the ones it straddles. Real and modulus
+// levels have to be sorted ascending.
+void contour_levels(Bytecode bc, const Complex *params, View view, unsigned int width, unsigned int height,
+                    float square_size, LevelField field, const float *levels, unsigned int count, Contours *out);
+
+#endif
@@ -0,0 +1,194 @@
+#include "lines.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_LINE 0xffffffffu
+
+static void reserve_lines(LineBuffer *buf, unsigned int count) {
+    if (count <= buf->capacity) return;
+    buf->capacity = buf->capacity ? buf->capacity : 256;
+    while (buf->capacity < count) buf->capacity *= 2;
+    buf->lines = realloc(buf->lines, buf->capacity * sizeof(Line));
+}
+void push_line(LineBuffer *buf, Line line) {
+    reserve_lines(buf, buf->count + 1);
+    buf->lines[buf->count++] = line;
+}
+void append_lines(LineBuffer *buf, const Line *lines, unsigned int count) {
+    reserve_lines(buf, buf->count + count);
+    memcpy(buf->lines + buf->count, lines, count * sizeof(Line));
+    buf->count += count;
+}
+void free_lines(LineBuffer *buf) {
+    free(buf->lines);
+    *buf = (LineBuffer){ 0 };
+}
+
+static void push_point(Polylines *p, Point pt) {
+    if (p->point_count == p->point_capacity) {
+        p->point_capacity = p->point_capacity ? p->point_capacity * 2 : 256;
+        p->points = realloc(p->points, p->point_capacity * sizeof(Point));
+    }
+    p->points[p->point_count++] = pt;
+}
+// Everything pushed since the last polyline ended becomes one
+static void end_polyline(Polylines *p) {
+    if (p->count + 2 > p->start_capacity) {
+        p->start_capacity *= 2;
+        p->starts = realloc(p->starts, p->start_capacity * sizeof(unsigned int));
+    }
+    p->starts[++p->count] = p->point_count;
+}
+
+void clear_polylines(Polylines *p) {
+    p->point_count = 0;
+    p->count = 0;
+    if (!p->start_capacity) {
+        p->start_capacity = 64;
+        p->starts = malloc(p->start_capacity * sizeof(unsigned int));
+    }
+    p->starts[0] = 0;
+}
+void free_polylines(Polylines *p) {
+    free(p->points);
+    free(p->starts);
+    *p = (Polylines){ 0 };
+}
+
+// Edge table: for each lattice edge, the (at most two) line ends on it.
+// An end is 2 * line + which, which being 0 for (x0, y0) and 1 for (x1, y1).
+typedef struct EdgeTable {
+    unsigned int *keys;
+    unsigned int (*ends)[2];
+    unsigned int mask;
+} EdgeTable;
+
+static unsigned int *slot_for(EdgeTable *t, unsigned int key) {
+    unsigned int h = (key * 2654435761u) & t->mask;
+    while (t->keys[h] != NO_LINE && t->keys[h] != key) h = (h + 1) & t->mask;
+    if (t->keys[h] == NO_LINE) {
+        t->keys[h] = key;
+        t->ends[h][0] = t->ends[h][1] = NO_LINE;
+    }
+    return t->ends[h];
+}
+
+// The end sharing an edge with this one, or NO_LINE
+static unsigned int partner(EdgeTable *t, const Line *lines, unsigned int end) {
+    const Line *l = &lines[end / 2];
+    unsigned int *ends = slot_for(t, end & 1 ? l->e1 : l->e0);
+    return ends[0] == end ? ends[1] : ends[0];
+}
+
+static Point end_point(const Line *lines, unsigned int end) {
+    const Line *l = &lines[end / 2];
+    return end & 1 ? (Point){ l->x1, l->y1 } : (Point){ l->x0, l->y0 };
+}
+
+void stitch(const Line *lines, unsigned int count, Polylines *out) {
+    clear_polylines(out);
+    if (!count) return;
+
+    unsigned int size = 16;
+    while (size < count * 4) size *= 2;
+    EdgeTable t = { malloc(size * sizeof(unsigned int)), malloc(size * sizeof(unsigned int[2])), size - 1 };
+    for (unsigned int i = 0; i < size; ++i) t.keys[i] = NO_LINE;
+
+    for (unsigned int end = 0; end < count * 2; ++end) {
+        const Line *l = &lines[end / 2];
+        unsigned int *ends = slot_for(&t, end & 1 ? l->e1 : l->e0);
+        ends[ends[0] == NO_LINE ? 0 : 1] = end;
+    }
+
+    bool *used = calloc(count, sizeof(bool));
+    unsigned int *chain = malloc((count + 1) * sizeof(unsigned int)); // ends, in walking order
+
+    for (unsigned int first = 0; first < count; ++first) {
+        if (used[first]) continue;
+
+        // every edge has at most two ends on it, so each chain is a path or a loop.
+        // walk backwards to the start of the path, or all the way round the loop.
+        unsigned int start = 2 * first;
+        for (unsigned int p; (p = partner(&t, lines, start)) != NO_LINE && p / 2 != first; )
+            start = p ^ 1;
+
+        // then forwards, through each line from the end we came in on to its far end
+        unsigned int n = 0, end = start;
+        bool closed = false;
+        chain[n++] = start;
+        while (true) {
+            used[end / 2] = true;
+            end ^= 1;
+            chain[n++] = end;
+            unsigned int p = partner(&t, lines, end);
+            if (p == NO_LINE) break;
+            if (p == start) { closed = true; break; }
+            end = p;
+        }
+
+        for (unsigned int i = 0; i < n; ++i) push_point(out, end_point(lines, chain[i]));
+        if (closed) out->points[out->point_count - 1] = out->points[out->starts[out->count]];
+        end_polyline(out);
+    }
+
+    free(chain);
+    free(used);
+    free(t.keys);
+    free(t.ends);
+}
+
+// Distance from p to the segment a-b
+static float distance(Point p, Point a, Point b) {
+    float dx = b.x - a.x, dy = b.y - a.y;
+    float length2 = dx * dx + dy * dy;
+    float t = length2 > 0 ? ((p.x - a.x) * dx + (p.y - a.y) * dy) / length2 : 0;
+    t = t < 0 ? 0 : t > 1 ? 1 : t;
+    float ex = a.x + t * dx - p.x, ey = a.y + t * dy - p.y;
+    return sqrtf(ex * ex + ey * ey);
+}
+
+void simplify(Polylines *p, float tolerance) {
+    bool *keep = calloc(p->point_count, sizeof(bool));
+    unsigned int (*ranges)[2] = malloc(p->point_count * sizeof(unsigned int[2]));
+
+    for (unsigned int i = 0; i < p->count; ++i) {
+        unsigned int first = p->starts[i], last = p->starts[i + 1] - 1;
+        keep[first] = keep[last] = true;
+
+        // split each range at its farthest point until everything is close enough.
+        // a closed loop's first and last points are the same, which distance()
+        // handles as a point, so the loop first splits at its farthest point.
+        unsigned int n = 0;
+        if (last > first + 1) { ranges[n][0] = first; ranges[n][1] = last; ++n; }
+        while (n) {
+            --n;
+            unsigned int a = ranges[n][0], b = ranges[n][1];
+            unsigned int farthest = a;
+            float worst = tolerance;
+            for (unsigned int k = a + 1; k < b; ++k) {
+                float d = distance(p->points[k], p->points[a], p->points[b]);
+                if (d > worst) { worst = d; farthest = k; }
+            }
+            if (farthest == a) continue;
+
+            keep[farthest] = true;
+            if (farthest > a + 1) { ranges[n][0] = a; ranges[n][1] = farthest; ++n; }
+            if (b > farthest + 1) { ranges[n][0] = farthest; ranges[n][1] = b; ++n; }
+        }
+    }
+
+    // compact in place
+    unsigned int w = 0;
+    for (unsigned int i = 0; i < p->count; ++i) {
+        unsigned int first = p->starts[i], last = p->starts[i + 1];
+        p->starts[i] = w;
+        for (unsigned int k = first; k < last; ++k)
+            if (keep[k]) p->points[w++] = p->points[k];
+    }
+    p->starts[p->count] = w;
+    p->point_count = w;
+
+    free(ranges);
+    free(keep);
+}
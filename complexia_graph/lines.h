@@ -0,0 +1,43 @@
+#ifndef LINES_H
+#define LINES_H
+
+#include <stdbool.h>
+
+typedef struct Line {
+    float x0, y0, x1, y1;
+    unsigned int e0, e1; // which lattice edge each end lies on, for stitching
+} Line;
+
+// Growable line storage. Meant to be cleared and refilled every frame, so
+// after the first few frames it stops allocating.
+typedef struct LineBuffer {
+    Line *lines;
+    unsigned int count, capacity;
+} LineBuffer;
+
+void push_line(LineBuffer *buf, Line line);
+void append_lines(LineBuffer *buf, const Line *lines, unsigned int count);
+void free_lines(LineBuffer *buf);
+
+typedef struct Point {
+    float x, y;
+} Point;
+
+// Polylines stored back to back: polyline i is points[starts[i]] up to
+// points[starts[i + 1]]. A closed one repeats its first point at the end.
+typedef struct Polylines {
+    Point *points;
+    unsigned int point_count, point_capacity;
+    unsigned int *starts; // count + 1 entries
+    unsigned int count, start_capacity;
+} Polylines;
+
+void clear_polylines(Polylines *p);
+void free_polylines(Polylines *p);
+
+// Join segments that meet on the same lattice edge into polylines
+void stitch(const Line *lines, unsigned int count, Polylines *out);
+// Drop points closer than tolerance to the simplified line (Douglas-Peucker)
+void simplify(Polylines *p, float tolerance);
+
+#endif
@@ -0,0 +1,262 @@
+#include "pipeline.h"
+#include <math.h>
+#include <pthread.h>
+
+#define REQUESTS 4 // frames waiting to be evaluated
+#define BLOCKS 64  // tiles of corner values in flight
+#define FRAMES 3   // finished contours: shown, waiting and being made
+
+// Bounded queue with one producer thread and one consumer thread. Holds more
+// than ever gets queued on it, so pushes don't fail.
+typedef struct Ring {
+    void *slots[BLOCKS]; // a power of two, and as many as anything queued
+    atomic_uint head;    // next to pop, only moved by the consumer
+    atomic_uint tail;    // next to push, only moved by the producer
+} Ring;
+
+static bool ring_push(Ring *r, void *item) {
+    unsigned int tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&r->head, memory_order_acquire) == BLOCKS) return false;
+    r->slots[tail % BLOCKS] = item;
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+static void *ring_pop(Ring *r) {
+    unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&r->tail, memory_order_acquire)) return NULL;
+    void *item = r->slots[head % BLOCKS];
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    return item;
+}
+
+static unsigned int ring_count(Ring *r) {
+    return atomic_load(&r->tail) - atomic_load(&r->head);
+}
+
+typedef struct Request {
+    Bytecode bc; // our own copy
+    Complex params[MAX_PARAMS];
+    bool has_params;
+    View view;
+    unsigned int width, height;
+    float square_size;
+} Request;
+
+// One tile's corners, or the end of a frame
+typedef struct Block {
+    bool end;   // no corners, the frame is complete
+    bool empty; // no contour in the tile, so no corners either
+    unsigned int x0, y0, w, h;
+    unsigned int cols; // frame lattice width
+    float square_size;
+    float v[(TILE_SQUARES + 1) * (TILE_SQUARES + 1)];
+} Block;
+
+struct Pipeline {
+    pthread_t evaluator, contourer;
+    atomic_bool quit;
+    pthread_mutex_t lock;  // only for sleeping on an empty ring
+    pthread_cond_t pushed; // something went onto a ring, or it's time to quit
+
+    Ring requests; // presentation -> evaluation
+    Ring corners;  // evaluation -> contouring
+    Ring blocks;   // contouring -> evaluation, empty blocks
+    Ring finished; // contouring -> presentation
+    Ring spare;    // presentation -> contouring, contours to reuse
+
+    Block *block_storage;
+    Contours frames[FRAMES];
+    Contours *shown;
+};
+
+// Nothing to do: sleep until something's pushed onto r. False if it's time to quit.
+static bool idle(Pipeline *p, Ring *r) {
+    pthread_mutex_lock(&p->lock);
+    while (!ring_count(r) && !atomic_load(&p->quit)) pthread_cond_wait(&p->pushed, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+    return !atomic_load(&p->quit);
+}
+
+// Push and wake whoever's waiting. Taking the lock means a consumer that
+// just found r empty is already waiting by the time we signal.
+static void send(Pipeline *p, Ring *r, void *item) {
+    ring_push(r, item);
+    pthread_mutex_lock(&p->lock);
+    pthread_cond_broadcast(&p->pushed);
+    pthread_mutex_unlock(&p->lock);
+}
+
+typedef struct Batch {
+    Kernel k;
+    const Complex *params;
+    Complex slots[MAX_PARAMS];
+    Grid g; // the frame's corner lattice
+    unsigned int tiles_x, first;
+    float square_size;
+    Block *blocks[BLOCKS];
+} Batch;
+
+static void evaluate_tile(void *arg, unsigned int index, unsigned int worker) {
+    Batch *b = arg;
+    Block *block = b->blocks[index];
+    unsigned int tile = b->first + index;
+    unsigned int x0 = tile % b->tiles_x * TILE_SQUARES, y0 = tile / b->tiles_x * TILE_SQUARES;
+    Grid g = {
+        { b->g.origin.real + x0 * b->g.dx, b->g.origin.imag + y0 * b->g.dy },
+        b->g.dx, b->g.dy,
+        b->g.w - x0 < TILE_SQUARES + 1 ? b->g.w - x0 : TILE_SQUARES + 1,
+        b->g.h - y0 < TILE_SQUARES + 1 ? b->g.h - y0 : TILE_SQUARES + 1
+    };
+    block->end = false;
+    block->empty = grid_contour_free(b->k, b->slots, g);
+    block->x0 = x0;
+    block->y0 = y0;
+    block->w = g.w;
+    block->h = g.h;
+    block->cols = b->g.w;
+    block->square_size = b->square_size;
+    if (block->empty) return;
+
+    // from the frame's lattice, so corners shared with the next tile come out the same
+    Complex values[(TILE_SQUARES + 1) * (TILE_SQUARES + 1)];
+    run_kernel_window(b->k, b->g, x0, y0, g.w, g.h, b->params, values);
+    for (unsigned int i = 0; i < g.w * g.h; ++i) block->v[i] = values[i].real;
+}
+
+static Block *free_block(Pipeline *p) {
+    Block *block;
+    while (!(block = ring_pop(&p->blocks)))
+        if (!idle(p, &p->blocks)) return NULL;
+    return block;
+}
+
+static void evaluate(Pipeline *p, Request *r) {
+    unsigned int squares_x = (unsigned int)ceilf(r->width / r->square_size);
+    unsigned int squares_y = (unsigned int)ceilf(r->height / r->square_size);
+    Pool *pool = render_pool();
+    unsigned int batch = 2 * pool_size(pool) < BLOCKS / 2 ? 2 * pool_size(pool) : BLOCKS / 2;
+
+    Batch b;
+    b.k = hoist(r->bc);
+    b.params = r->has_params ? r->params : NULL;
+    kernel_slots(b.k, b.params, b.slots);
+    b.g = (Grid){
+        { r->view.center.real - r->width / 2.0f * r->view.scale, r->view.center.imag + r->height / 2.0f * r->view.scale },
+        r->square_size * r->view.scale, -r->square_size * r->view.scale,
+        squares_x + 1, squares_y + 1
+    };
+    b.square_size = r->square_size;
+    b.tiles_x = (squares_x + TILE_SQUARES - 1) / TILE_SQUARES;
+    unsigned int tiles = b.tiles_x * ((squares_y + TILE_SQUARES - 1) / TILE_SQUARES);
+
+    // a batch at a time, handing each on as soon as it's done
+    for (b.first = 0; b.first < tiles; b.first += batch) {
+        unsigned int n = tiles - b.first < batch ? tiles - b.first : batch;
+        for (unsigned int i = 0; i < n; ++i)
+            if (!(b.blocks[i] = free_block(p))) goto quit;
+        pool_run(pool, evaluate_tile, &b, n);
+        for (unsigned int i = 0; i < n; ++i) send(p, &p->corners, b.blocks[i]);
+    }
+    Block *end = free_block(p);
+    if (end) {
+        end->end = true;
+        send(p, &p->corners, end);
+    }
+quit:
+    free_kernel(&b.k);
+}
+
+static void *evaluator_main(void *arg) {
+    Pipeline *p = arg;
+    do {
+        Request *r;
+        while ((r = ring_pop(&p->requests))) {
+            evaluate(p, r);
+            free(r->bc.data);
+            free(r);
+        }
+    } while (idle(p, &p->requests));
+    return NULL;
+}
+
+static void *contourer_main(void *arg) {
+    Pipeline *p = arg;
+    LineBuffer lines = { 0 };
+    do {
+        Block *block;
+        while ((block = ring_pop(&p->corners))) {
+            if (block->end) {
+                Contours *c;
+                while (!(c = ring_pop(&p->spare)))
+                    if (!idle(p, &p->spare)) goto quit;
+                // only the polylines get shown, but keep the segments too
+                c->lines.count = 0;
+                append_lines(&c->lines, lines.lines, lines.count);
+                stitch(lines.lines, lines.count, &c->polylines);
+                simplify(&c->polylines, SIMPLIFY_TOLERANCE);
+                send(p, &p->finished, c);
+                lines.count = 0;
+            } else if (!block->empty) {
+                march_values(block->v, block->w, block->h, block->x0, block->y0, block->cols, block->square_size, &lines);
+            }
+            send(p, &p->blocks, block);
+        }
+    } while (idle(p, &p->corners));
+quit:
+    free_lines(&lines);
+    return NULL;
+}
+
+Pipeline *pipeline_create(void) {
+    Pipeline *p = calloc(1, sizeof(Pipeline));
+    p->block_storage = malloc(BLOCKS * sizeof(Block));
+    for (unsigned int i = 0; i < BLOCKS; ++i) ring_push(&p->blocks, &p->block_storage[i]);
+    for (unsigned int i = 0; i < FRAMES; ++i) ring_push(&p->spare, &p->frames[i]);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->pushed, NULL);
+    pthread_create(&p->evaluator, NULL, evaluator_main, p);
+    pthread_create(&p->contourer, NULL, contourer_main, p);
+    return p;
+}
+
+void pipeline_destroy(Pipeline *p) {
+    pthread_mutex_lock(&p->lock);
+    atomic_store(&p->quit, true);
+    pthread_cond_broadcast(&p->pushed);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->evaluator, NULL);
+    pthread_join(p->contourer, NULL);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->pushed);
+
+    Request *r;
+    while ((r = ring_pop(&p->requests))) {
+        free(r->bc.data);
+        free(r);
+    }
+    for (unsigned int i = 0; i < FRAMES; ++i) free_contours(&p->frames[i]);
+    free(p->block_storage);
+    free(p);
+}
+
+bool pipeline_submit(Pipeline *p, Bytecode bc, const Complex *params, View view,
+                     unsigned int width, unsigned int height, float square_size) {
+    if (ring_count(&p->requests) >= REQUESTS) return false;
+    Request *r = malloc(sizeof(Request));
+    *r = (Request){ { bc.length, malloc(bc.length) }, { { 0 } }, params != NULL, view, width, height, square_size };
+    memcpy(r->bc.data, bc.data, bc.length);
+    if (params) memcpy(r->params, params, sizeof(r->params));
+    send(p, &p->requests, r);
+    return true;
+}
+
+const Contours *pipeline_take(Pipeline *p) {
+    // skip to the newest, handing the others straight back
+    Contours *c;
+    while ((c = ring_pop(&p->finished))) {
+        if (p->shown) send(p, &p->spare, p->shown);
+        p->shown = c;
+    }
+    return p->shown;
+}
@@ -0,0 +1,26 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "contour.h"
+
+// Contouring as three stages on their own threads, so one frame's corners
+// can be evaluated while the one before is being marched and the one
+// before that drawn:
+//   evaluation: tiles of corner values, a batch at a time on the render pool
+//   contouring: marching squares, stitching and simplifying
+//   presentation: whoever calls pipeline_take
+// Stages hand work on through bounded lock-free queues, and sleep while
+// theirs are empty.
+typedef struct Pipeline Pipeline;
+
+Pipeline *pipeline_create(void);
+void pipeline_destroy(Pipeline *p);
+// Queue a frame. bc and params are copied, params can be NULL. False if
+// too many frames are already waiting to be evaluated.
+bool pipeline_submit(Pipeline *p, Bytecode bc, const Complex *params, View view,
+                     unsigned int width, unsigned int height, float square_size);
+// The newest finished frame, or NULL before the first. Stays valid until
+// the next call.
+const Contours *pipeline_take(Pipeline *p);
+
+#endif
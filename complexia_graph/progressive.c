@@ -0,0 +1,67 @@
+#include "progressive.h"
+#include <math.h>
+#include <time.h>
+
+static double seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+Progressive new_progressive(float budget, float finest, float coarsest) {
+    Progressive p = { budget, finest, coarsest };
+    return p;
+}
+
+void free_progressive(Progressive *p) {
+    free_contours(&p->contours);
+    free_contours(&p->refining);
+    p->done = 0;
+    p->next_tile = 0;
+}
+
+void restart_progressive(Progressive *p) {
+    p->done = 0;
+    p->next_tile = 0;
+}
+
+// Square sizes go finest * 2^k, so a refinement splits every square in four
+static float affordable(Progressive *p, unsigned int width, unsigned int height) {
+    float s = p->finest;
+    while (s * 2 <= p->coarsest && p->cost * (width / s) * (height / s) > p->budget) s *= 2;
+    return s;
+}
+
+bool progress(Progressive *p, Bytecode bc, const Complex *params, View view, unsigned int width, unsigned int height) {
+    bool moved = view.center.real != p->view.center.real || view.center.imag != p->view.center.imag ||
+                 view.scale != p->view.scale || width != p->width || height != p->height;
+    if (moved) restart_progressive(p);
+    if (p->done && p->done <= p->finest) return false;
+
+    // when it's holding still, the next level finer, a budget's worth of tiles at a time
+    if (p->done) {
+        float s = fmaxf(p->done / 2, p->finest);
+        if (contour_budgeted(bc, params, view, width, height, s, p->budget, &p->next_tile, &p->refining)) {
+            Contours finer = p->refining;
+            p->refining = p->contours;
+            p->contours = finer;
+            p->done = s;
+            p->next_tile = 0;
+        }
+        return true;
+    }
+
+    // nothing measured yet, so start as coarse as allowed
+    float s = p->cost > 0 ? affordable(p, width, height) : p->coarsest;
+    double start = seconds();
+    contour(bc, params, view, width, height, s, &p->contours);
+    float measured = (float)(seconds() - start) / ((width / s) * (height / s));
+    // smooth it a little, since a frame here and there gets interrupted
+    p->cost = p->cost > 0 ? 0.5f * (p->cost + measured) : measured;
+
+    p->done = s;
+    p->view = view;
+    p->width = width;
+    p->height = height;
+    return true;
+}
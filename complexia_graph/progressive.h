@@ -0,0 +1,34 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include "contour.h"
+
+// Contouring spread over frames. While the view moves, every frame gets the
+// finest square size that its measured cost says fits the budget. Once the
+// view holds still, it works on one level finer (halving the square size) a
+// budget's worth of tiles per frame, and shows it once it's complete, until
+// reaching the finest. Then it stops rendering at all.
+typedef struct Progressive {
+    float budget;   // seconds per frame
+    float finest;   // smallest square size, in pixels
+    float coarsest; // largest square size, in pixels
+
+    float cost;     // seconds per square, measured
+    float done;     // square size the contours are at, 0 for nothing yet
+    View view;
+    unsigned int width, height;
+    Contours contours;
+    Contours refining;      // the next level while it's under way
+    unsigned int next_tile; // of refining
+} Progressive;
+
+// Start it like this, keep it between frames, and free it when done
+Progressive new_progressive(float budget, float finest, float coarsest);
+void free_progressive(Progressive *p);
+// Throw away what's done, for when the expression or its parameters change
+void restart_progressive(Progressive *p);
+// Render whatever this frame should into p->contours. False if the
+// contours were already as fine as they get.
+bool progress(Progressive *p, Bytecode bc, const Complex *params, View view, unsigned int width, unsigned int height);
+
+#endif
@@ -0,0 +1,33 @@
+#include "raster.h"
+#include <math.h>
+#include <stddef.h>
+
+void clear_raster(Raster r, uint32_t color) {
+    for (unsigned int y = 0; y < r.height; ++y) {
+        uint32_t *row = (uint32_t *)((char *)r.pixels + (size_t)y * r.pitch);
+        for (unsigned int x = 0; x < r.width; ++x) row[x] = color;
+    }
+}
+
+// Step one pixel at a time along the longer axis
+static void segment(Raster r, Point a, Point b, uint32_t color) {
+    float dx = b.x - a.x, dy = b.y - a.y;
+    float length = fmaxf(fabsf(dx), fabsf(dy));
+    unsigned int steps = length < 1 ? 1 : (unsigned int)ceilf(length);
+    for (unsigned int i = 0; i <= steps; ++i) {
+        float x = floorf(a.x + dx * i / steps), y = floorf(a.y + dy * i / steps);
+        if (x < 0 || y < 0 || x >= r.width || y >= r.height) continue;
+        ((uint32_t *)((char *)r.pixels + (size_t)y * r.pitch))[(unsigned int)x] = color;
+    }
+}
+
+void rasterize_lines(Raster r, const Line *lines, unsigned int count, uint32_t color) {
+    for (unsigned int i = 0; i < count; ++i)
+        segment(r, (Point){ lines[i].x0, lines[i].y0 }, (Point){ lines[i].x1, lines[i].y1 }, color);
+}
+
+void rasterize_polylines(Raster r, const Polylines *p, uint32_t color) {
+    for (unsigned int i = 0; i < p->count; ++i)
+        for (unsigned int k = p->starts[i] + 1; k < p->starts[i + 1]; ++k)
+            segment(r, p->points[k - 1], p->points[k], color);
+}
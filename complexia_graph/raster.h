@@ -0,0 +1,18 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include "lines.h"
+#include <stdint.h>
+
+// Caller owned 0xAARRGGBB pixels, rows pitch bytes apart
+typedef struct Raster {
+    uint32_t *pixels;
+    unsigned int width, height, pitch;
+} Raster;
+
+void clear_raster(Raster r, uint32_t color);
+// One pixel wide lines in pixel coordinates. Whatever is off the raster is clipped.
+void rasterize_lines(Raster r, const Line *lines, unsigned int count, uint32_t color);
+void rasterize_polylines(Raster r, const Polylines *p, uint32_t color);
+
+#endif
@@ -0,0 +1,129 @@
+#include "squares.h"
+#include <math.h>
+
+// Kept between frames so a steady view doesn't allocate
+static struct {
+    Contours contours;
+    Contours presented; // from the background renderer
+    Contours *levels;   // one per level
+    unsigned int level_count;
+
+    SDL_Vertex *vertices;
+    int *indices;
+    unsigned int capacity; // in quads
+} buffers;
+
+static void reserve_quads(unsigned int count) {
+    if (count <= buffers.capacity) return;
+    buffers.capacity = count * 2;
+    buffers.vertices = realloc(buffers.vertices, buffers.capacity * 4 * sizeof(SDL_Vertex));
+    buffers.indices = realloc(buffers.indices, buffers.capacity * 6 * sizeof(int));
+}
+
+// A one pixel wide quad along a-b, so lines can all go in one draw call
+static void put_quad(unsigned int i, Point a, Point b, SDL_Color color) {
+    float dx = b.x - a.x, dy = b.y - a.y;
+    float length = sqrtf(dx * dx + dy * dy);
+    float nx = length > 0 ? -dy / length * 0.5f : 0, ny = length > 0 ? dx / length * 0.5f : 0;
+
+    SDL_Vertex *v = buffers.vertices + i * 4;
+    v[0] = (SDL_Vertex){ { a.x + nx, a.y + ny }, color, { 0, 0 } };
+    v[1] = (SDL_Vertex){ { a.x - nx, a.y - ny }, color, { 0, 0 } };
+    v[2] = (SDL_Vertex){ { b.x + nx, b.y + ny }, color, { 0, 0 } };
+    v[3] = (SDL_Vertex){ { b.x - nx, b.y - ny }, color, { 0, 0 } };
+
+    int *idx = buffers.indices + i * 6;
+    idx[0] = i * 4;     idx[1] = i * 4 + 1; idx[2] = i * 4 + 2;
+    idx[3] = i * 4 + 2; idx[4] = i * 4 + 1; idx[5] = i * 4 + 3;
+}
+
+void render(Bytecode bc, const Complex *params, View view, float square_size, SDL_Renderer *renderer) {
+    int width, height;
+    SDL_GetRendererOutputSize(renderer, &width, &height);
+    contour(bc, params, view, width, height, square_size, &buffers.contours);
+    draw_polylines(renderer, &buffers.contours.polylines);
+}
+
+void render_adaptive(Bytecode bc, const Complex *params, View view, float min_square, float variation, SDL_Renderer *renderer) {
+    int width, height;
+    SDL_GetRendererOutputSize(renderer, &width, &height);
+    contour_adaptive(bc, params, view, width, height, min_square, variation, &buffers.contours);
+    draw_polylines(renderer, &buffers.contours.polylines);
+}
+
+void render_progressive(Progressive *p, Bytecode bc, const Complex *params, View view, SDL_Renderer *renderer) {
+    int width, height;
+    SDL_GetRendererOutputSize(renderer, &width, &height);
+    progress(p, bc, params, view, width, height);
+    draw_polylines(renderer, &p->contours.polylines);
+}
+
+unsigned int render_cached(TileCache *cache, Bytecode bc, const Complex *params, View view, float square_size,
+                           unsigned int max_new, SDL_Renderer *renderer) {
+    int width, height;
+    SDL_GetRendererOutputSize(renderer, &width, &height);
+    unsigned int missing = contour_cached(cache, bc, params, view, width, height, square_size, max_new, &buffers.contours);
+    draw_polylines(renderer, &buffers.contours.polylines);
+    return missing;
+}
+
+void render_levels(Bytecode bc, const Complex *params, View view, float square_size, LevelField field,
+                   const float *levels, unsigned int count, SDL_Renderer *renderer) {
+    if (count > buffers.level_count) {
+        buffers.levels = realloc(buffers.levels, count * sizeof(Contours));
+        memset(buffers.levels + buffers.level_count, 0, (count - buffers.level_count) * sizeof(Contours));
+        buffers.level_count = count;
+    }
+    int width, height;
+    SDL_GetRendererOutputSize(renderer, &width, &height);
+    contour_levels(bc, params, view, width, height, square_size, field, levels, count, buffers.levels);
+    for (unsigned int k = 0; k < count; ++k) draw_polylines(renderer, &buffers.levels[k].polylines);
+}
+
+void present_async(AsyncRender *a, SDL_Renderer *renderer) {
+    View view;
+    async_take(a, &buffers.presented, &view);
+    draw_polylines(renderer, &buffers.presented.polylines);
+}
+
+void present_pipeline(Pipeline *p, SDL_Renderer *renderer) {
+    const Contours *c = pipeline_take(p);
+    if (c) draw_polylines(renderer, &c->polylines);
+}
+
+void render_coloring(Bytecode bc, const Complex *params, View view, SDL_Texture *texture, SDL_Renderer *renderer) {
+    int width, height, pitch;
+    void *pixels;
+    SDL_QueryTexture(texture, NULL, NULL, &width, &height);
+    if (SDL_LockTexture(texture, NULL, &pixels, &pitch)) {
+        printf("Couldn't lock the colouring texture\n");
+        return;
+    }
+    color_pixels(bc, params, view, width, height, pixels, pitch);
+    SDL_UnlockTexture(texture);
+    SDL_RenderCopy(renderer, texture, NULL, NULL);
+}
+
+void draw_lines(SDL_Renderer *renderer, const Line *lines, unsigned int count) {
+    if (!count) return;
+    reserve_quads(count);
+
+    SDL_Color color;
+    SDL_GetRenderDrawColor(renderer, &color.r, &color.g, &color.b, &color.a);
+    for (unsigned int i = 0; i < count; ++i)
+        put_quad(i, (Point){ lines[i].x0, lines[i].y0 }, (Point){ lines[i].x1, lines[i].y1 }, color);
+    SDL_RenderGeometry(renderer, NULL, buffers.vertices, count * 4, buffers.indices, count * 6);
+}
+
+void draw_polylines(SDL_Renderer *renderer, const Polylines *p) {
+    if (p->point_count < 2) return;
+    reserve_quads(p->point_count);
+
+    SDL_Color color;
+    SDL_GetRenderDrawColor(renderer, &color.r, &color.g, &color.b, &color.a);
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < p->count; ++i)
+        for (unsigned int k = p->starts[i] + 1; k < p->starts[i + 1]; ++k)
+            put_quad(n++, p->points[k - 1], p->points[k], color);
+    SDL_RenderGeometry(renderer, NULL, buffers.vertices, n * 4, buffers.indices, n * 6);
+}
@@ -1,14 +1,40 @@
 #ifndef SQUARES_H
 #define SQUARES_H
 
-#include "../backend.h"
+#include "contour.h"
+#include "async.h"
+#include "pipeline.h"
+#include "coloring.h"
+#include "progressive.h"
+#include "tiles.h"
+#include "levels.h"
 #include <SDL2/SDL_render.h>
 
-typedef struct Line {
-    float x0, y0, x1, y1;
-} Line;
+// SDL presentation of the headless renderers in contour.h, progressive.h,
+// tiles.h, levels.h, async.h, pipeline.h and coloring.h
 
-float eval_at(Bytecode bc, Complex pos);
-void render(Bytecode bc, float square_size, SDL_Renderer *renderer);
+// Contours of Re(f) over the whole renderer, see contour and contour_adaptive
+void render(Bytecode bc, const Complex *params, View view, float square_size, SDL_Renderer *renderer);
+void render_adaptive(Bytecode bc, const Complex *params, View view, float min_square, float variation, SDL_Renderer *renderer);
+// Contours refined over frames within p's budget, see progress
+void render_progressive(Progressive *p, Bytecode bc, const Complex *params, View view, SDL_Renderer *renderer);
+// Contours out of cache's tiles, see contour_cached. Returns how many
+// visible tiles are still missing, so it's worth another frame until 0.
+unsigned int render_cached(TileCache *cache, Bytecode bc, const Complex *params, View view, float square_size,
+                           unsigned int max_new, SDL_Renderer *renderer);
+// Contours where field(f) equals each of levels, all in the current draw
+// colour, see contour_levels
+void render_levels(Bytecode bc, const Complex *params, View view, float square_size, LevelField field,
+                   const float *levels, unsigned int count, SDL_Renderer *renderer);
+// Draw the newest contours the background renderer has finished, without
+// waiting for anything still in flight
+void present_async(AsyncRender *a, SDL_Renderer *renderer);
+// Draw the newest frame out of the pipeline, if there's been one yet
+void present_pipeline(Pipeline *p, SDL_Renderer *renderer);
+// Domain colouring into a streaming ARGB8888 texture, which is then copied over the renderer
+void render_coloring(Bytecode bc, const Complex *params, View view, SDL_Texture *texture, SDL_Renderer *renderer);
+// Draw all lines in the current draw colour with a single SDL call
+void draw_lines(SDL_Renderer *renderer, const Line *lines, unsigned int count);
+void draw_polylines(SDL_Renderer *renderer, const Polylines *p);
 
-#endif
\ No newline at end of file
+#endif
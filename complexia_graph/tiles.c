@@ -0,0 +1,306 @@
+#include "tiles.h"
+#include <math.h>
+
+#define LOCAL_KEYS (2 * (TILE_SQUARES + 1) * (TILE_SQUARES + 1)) // edge keys within a tile
+// Lattice corners either side of 0 in a level's lattice, keeping every index exact as a float
+#define LEVEL_ORIGIN (1u << 22)
+
+TileCache new_tile_cache(size_t budget) {
+    TileCache c = { budget, 0 };
+    c.table_size = 64;
+    c.table = calloc(c.table_size, sizeof(CachedTile *));
+    return c;
+}
+
+void free_tile_cache(TileCache *c) {
+    for (CachedTile *t = c->newest, *older; t; t = older) {
+        older = t->older;
+        free(t->lines);
+        free(t);
+    }
+    free(c->table);
+    *c = (TileCache){ 0 };
+}
+
+// FNV-1a
+static uint64_t mix(uint64_t h, const void *data, size_t n) {
+    for (size_t i = 0; i < n; ++i) h = (h ^ ((const unsigned char *)data)[i]) * 0x100000001b3ull;
+    return h;
+}
+
+uint64_t expression_hash(Bytecode bc, const Complex *params) {
+    uint64_t h = mix(0xcbf29ce484222325ull, bc.data, bc.length);
+    unsigned int idx = 0;
+    while (idx < bc.length) {
+        switch (bc.data[idx]) {
+            case OP_CONST: idx += 1 + sizeof(float) * 2; break;
+            case OP_PARAM:
+                h = mix(h, &params[bc.data[idx + 1]], sizeof(Complex));
+                idx += 2;
+                break;
+            case OP_STORE:
+            case OP_LOAD:  idx += 2; break;
+            case OP_POLY:  idx += 3 + ((bc.data[idx + 1] | bc.data[idx + 2] << 8) + 1) * sizeof(Complex); break;
+            default:       ++idx; break;
+        }
+    }
+    return h;
+}
+
+static unsigned int key_hash(TileKey k, unsigned int size) {
+    uint64_t h = mix(k.expr, &k.level, sizeof(int));
+    h = mix(h, &k.x, sizeof(int));
+    h = mix(h, &k.y, sizeof(int));
+    return (unsigned int)(h & (size - 1));
+}
+
+static bool same_key(TileKey a, TileKey b) {
+    return a.expr == b.expr && a.level == b.level && a.x == b.x && a.y == b.y;
+}
+
+static void unlink_tile(TileCache *c, CachedTile *t) {
+    if (t->newer) t->newer->older = t->older;
+    else c->newest = t->older;
+    if (t->older) t->older->newer = t->newer;
+    else c->oldest = t->newer;
+}
+
+static void link_newest(TileCache *c, CachedTile *t) {
+    t->newer = NULL;
+    t->older = c->newest;
+    if (c->newest) c->newest->newer = t;
+    else c->oldest = t;
+    c->newest = t;
+}
+
+static CachedTile *find_tile(TileCache *c, TileKey key) {
+    for (CachedTile *t = c->table[key_hash(key, c->table_size)]; t; t = t->next) {
+        if (!same_key(t->key, key)) continue;
+        unlink_tile(c, t);
+        link_newest(c, t);
+        return t;
+    }
+    return NULL;
+}
+
+static size_t tile_bytes(const CachedTile *t) {
+    return sizeof(CachedTile) + t->count * sizeof(Line);
+}
+
+static void evict_oldest(TileCache *c) {
+    CachedTile *t = c->oldest;
+    CachedTile **slot = &c->table[key_hash(t->key, c->table_size)];
+    while (*slot != t) slot = &(*slot)->next;
+    *slot = t->next;
+    unlink_tile(c, t);
+    c->used -= tile_bytes(t);
+    --c->count;
+    free(t->lines);
+    free(t);
+}
+
+// Takes over lines
+static void insert_tile(TileCache *c, TileKey key, Line *lines, unsigned int count) {
+    if (c->count >= c->table_size) {
+        unsigned int size = c->table_size * 2;
+        CachedTile **table = calloc(size, sizeof(CachedTile *));
+        for (unsigned int i = 0; i < c->table_size; ++i) {
+            for (CachedTile *t = c->table[i], *next; t; t = next) {
+                next = t->next;
+                unsigned int h = key_hash(t->key, size);
+                t->next = table[h];
+                table[h] = t;
+            }
+        }
+        free(c->table);
+        c->table = table;
+        c->table_size = size;
+    }
+
+    CachedTile *t = malloc(sizeof(CachedTile));
+    *t = (CachedTile){ key, lines, count };
+    unsigned int h = key_hash(key, c->table_size);
+    t->next = c->table[h];
+    c->table[h] = t;
+    link_newest(c, t);
+    c->used += tile_bytes(t);
+    ++c->count;
+}
+
+// Only once the frame is placed, so nothing it needs goes missing halfway.
+// Its tiles were touched last, so they're the last to go.
+static void trim(TileCache *c) {
+    while (c->used > c->budget && c->oldest != c->newest) evict_oldest(c);
+}
+
+typedef struct Pending {
+    TileKey key;
+    LineBuffer lines;
+} Pending;
+
+typedef struct Fill {
+    Kernel k;
+    const Complex *params;
+    Complex slots[MAX_PARAMS];
+    Pending *pending;
+} Fill;
+
+static Grid tile_grid(TileKey key) {
+    float d = ldexpf(1.0f, key.level);
+    return (Grid){
+        { (float)key.x * TILE_SQUARES * d, -(float)key.y * TILE_SQUARES * d },
+        d, -d, TILE_SQUARES + 1, TILE_SQUARES + 1
+    };
+}
+
+// All of a level's tiles are windows of this lattice, so neighbours work out
+// their shared corners the same way. Corner (x, y) of tile (0, 0) is lattice
+// point (x + LEVEL_ORIGIN, y + LEVEL_ORIGIN).
+static Grid level_grid(int level) {
+    float d = ldexpf(1.0f, level);
+    return (Grid){
+        { -(float)LEVEL_ORIGIN * d, (float)LEVEL_ORIGIN * d },
+        d, -d, 2 * LEVEL_ORIGIN + 1, 2 * LEVEL_ORIGIN + 1
+    };
+}
+
+static void fill_tile(void *arg, unsigned int index, unsigned int worker) {
+    Fill *f = arg;
+    Pending *p = &f->pending[index];
+    if (grid_contour_free(f->k, f->slots, tile_grid(p->key))) return;
+
+    unsigned int x0 = LEVEL_ORIGIN + p->key.x * TILE_SQUARES, y0 = LEVEL_ORIGIN + p->key.y * TILE_SQUARES;
+    Complex values[(TILE_SQUARES + 1) * (TILE_SQUARES + 1)];
+    float v[(TILE_SQUARES + 1) * (TILE_SQUARES + 1)];
+    run_kernel_window(f->k, level_grid(p->key.level), x0, y0, TILE_SQUARES + 1, TILE_SQUARES + 1, f->params, values);
+    for (unsigned int i = 0; i < (TILE_SQUARES + 1) * (TILE_SQUARES + 1); ++i) v[i] = values[i].real;
+    // lattice units, keys local to the tile
+    march_values(v, TILE_SQUARES + 1, TILE_SQUARES + 1, 0, 0, TILE_SQUARES + 1, 1.0f, &p->lines);
+}
+
+static int floor_div(int a, int b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// Where the frame's lattice starts, for turning tile local things into pixels and keys
+typedef struct Placement {
+    View view;
+    float left, top; // plane coordinates of pixel (0, 0)
+    int level, tx0, ty0;
+    unsigned int cols; // frame lattice corners across
+    unsigned int next_borrowed; // edge keys for borrowed tiles start here
+} Placement;
+
+static Point to_pixel(const Placement *at, TileKey key, float lx, float ly) {
+    float d = ldexpf(1.0f, key.level);
+    float re = ((float)key.x * TILE_SQUARES + lx) * d, im = -((float)key.y * TILE_SQUARES + ly) * d;
+    return (Point){ (re - at->left) / at->view.scale, (at->top - im) / at->view.scale };
+}
+
+static unsigned int frame_key(const Placement *at, TileKey key, unsigned int local) {
+    unsigned int lx = local / 2 % (TILE_SQUARES + 1), ly = local / 2 / (TILE_SQUARES + 1);
+    unsigned int x = (key.x - at->tx0) * TILE_SQUARES + lx, y = (key.y - at->ty0) * TILE_SQUARES + ly;
+    return 2 * (y * at->cols + x) + (local & 1);
+}
+
+static void place(const Placement *at, const CachedTile *t, LineBuffer *out) {
+    for (unsigned int i = 0; i < t->count; ++i) {
+        Line l = t->lines[i];
+        Point a = to_pixel(at, t->key, l.x0, l.y0), b = to_pixel(at, t->key, l.x1, l.y1);
+        push_line(out, (Line){ a.x, a.y, b.x, b.y, frame_key(at, t->key, l.e0), frame_key(at, t->key, l.e1) });
+    }
+}
+
+// Segments of another level's tile standing in for the missing tile at
+// key. Only those whose middle is inside it, and with edge keys of their own.
+static void borrow(Placement *at, const CachedTile *t, TileKey key, LineBuffer *out) {
+    Point lo = to_pixel(at, key, 0, 0), hi = to_pixel(at, key, TILE_SQUARES, TILE_SQUARES);
+    unsigned int base = at->next_borrowed;
+    at->next_borrowed += LOCAL_KEYS;
+    for (unsigned int i = 0; i < t->count; ++i) {
+        Line l = t->lines[i];
+        Point a = to_pixel(at, t->key, l.x0, l.y0), b = to_pixel(at, t->key, l.x1, l.y1);
+        float mx = (a.x + b.x) / 2, my = (a.y + b.y) / 2;
+        if (mx < lo.x || mx >= hi.x || my < lo.y || my >= hi.y) continue;
+        push_line(out, (Line){ a.x, a.y, b.x, b.y, base + l.e0, base + l.e1 });
+    }
+}
+
+unsigned int contour_cached(TileCache *cache, Bytecode bc, const Complex *params, View view,
+                            unsigned int width, unsigned int height, float square_size,
+                            unsigned int max_new, Contours *out) {
+    Placement at;
+    at.view = view;
+    at.left = view.center.real - width / 2.0f * view.scale;
+    at.top = view.center.imag + height / 2.0f * view.scale;
+    at.level = (int)floorf(log2f(square_size * view.scale) + 0.5f);
+    float span = ldexpf(TILE_SQUARES, at.level); // plane units per tile
+    at.tx0 = (int)floorf(at.left / span);
+    at.ty0 = (int)floorf(-at.top / span);
+    int tx1 = (int)floorf((at.left + width * view.scale) / span);
+    int ty1 = (int)floorf((height * view.scale - at.top) / span);
+    unsigned int tiles_x = tx1 - at.tx0 + 1, tiles_y = ty1 - at.ty0 + 1;
+    at.cols = tiles_x * TILE_SQUARES + 1;
+    at.next_borrowed = 2 * at.cols * (tiles_y * TILE_SQUARES + 1);
+
+    uint64_t expr = expression_hash(bc, params);
+
+    // evaluate what's missing, up to max_new of it, all at once on the pool
+    Pending *pending = calloc(tiles_x * tiles_y, sizeof(Pending));
+    unsigned int missing = 0;
+    for (int ty = at.ty0; ty <= ty1; ++ty) {
+        for (int tx = at.tx0; tx <= tx1; ++tx) {
+            TileKey key = { expr, at.level, tx, ty };
+            if (!find_tile(cache, key)) pending[missing++].key = key;
+        }
+    }
+    unsigned int fill = max_new && max_new < missing ? max_new : missing;
+    if (fill) {
+        Fill f;
+        f.k = hoist(bc);
+        f.params = params;
+        kernel_slots(f.k, params, f.slots);
+        f.pending = pending;
+        pool_run(render_pool(), fill_tile, &f, fill);
+        free_kernel(&f.k);
+        for (unsigned int i = 0; i < fill; ++i) {
+            LineBuffer *lines = &pending[i].lines;
+            if (lines->count) lines->lines = realloc(lines->lines, lines->count * sizeof(Line));
+            else {
+                free(lines->lines);
+                lines->lines = NULL;
+            }
+            insert_tile(cache, pending[i].key, lines->lines, lines->count);
+        }
+    }
+    free(pending);
+
+    out->lines.count = 0;
+    for (int ty = at.ty0; ty <= ty1; ++ty) {
+        for (int tx = at.tx0; tx <= tx1; ++tx) {
+            TileKey key = { expr, at.level, tx, ty };
+            CachedTile *t = find_tile(cache, key);
+            if (t) {
+                place(&at, t, &out->lines);
+                continue;
+            }
+
+            // zoomed in: the coarser parent. Zoomed out: the four finer children.
+            TileKey parent = { expr, at.level + 1, floor_div(tx, 2), floor_div(ty, 2) };
+            if ((t = find_tile(cache, parent))) {
+                borrow(&at, t, key, &out->lines);
+                continue;
+            }
+            for (int i = 0; i < 4; ++i) {
+                TileKey child = { expr, at.level - 1, 2 * tx + i % 2, 2 * ty + i / 2 };
+                if ((t = find_tile(cache, child))) borrow(&at, t, key, &out->lines);
+            }
+        }
+    }
+
+    trim(cache);
+
+    stitch(out->lines.lines, out->lines.count, &out->polylines);
+    simplify(&out->polylines, SIMPLIFY_TOLERANCE);
+    return missing - fill;
+}
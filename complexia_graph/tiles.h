@@ -0,0 +1,48 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include "contour.h"
+#include <stdint.h>
+
+// Level l puts lattice corners 2^l plane units apart, at integer multiples
+// of 2^l, so tiles stay the same as the view pans. Tile (x, y) covers
+// lattice corners x * TILE_SQUARES to (x + 1) * TILE_SQUARES across and
+// the same down from the real axis, rows going down. Tiles reach 2^17 either
+// way from 0 on each level.
+typedef struct TileKey {
+    uint64_t expr; // from expression_hash
+    int level, x, y;
+} TileKey;
+
+typedef struct CachedTile {
+    TileKey key;
+    Line *lines; // in lattice units from the tile's top left, edge keys local to the tile
+    unsigned int count;
+    struct CachedTile *next;          // hash chain
+    struct CachedTile *newer, *older; // least recently used order
+} CachedTile;
+
+// Contour segments of tiles over all levels, evicting the least recently
+// used ones once they take more than budget bytes
+typedef struct TileCache {
+    size_t budget, used;
+    CachedTile **table;
+    unsigned int table_size, count;
+    CachedTile *newest, *oldest;
+} TileCache;
+
+TileCache new_tile_cache(size_t budget);
+void free_tile_cache(TileCache *c);
+// Identifies bc along with the parameter values it reads
+uint64_t expression_hash(Bytecode bc, const Complex *params);
+
+// Like contour, but built out of cached tiles at the level nearest
+// square_size pixels, so panning only evaluates the newly exposed tiles.
+// At most max_new missing tiles are evaluated (0 for no limit). The
+// others borrow a cached parent or child tile's segments while they wait.
+// Returns how many visible tiles are still missing.
+unsigned int contour_cached(TileCache *cache, Bytecode bc, const Complex *params, View view,
+                            unsigned int width, unsigned int height, float square_size,
+                            unsigned int max_new, Contours *out);
+
+#endif
@@ -0,0 +1,279 @@
+#include "dag.h"
+
+unsigned int arity(Opcode op) {
+    switch (op) {
+        case OP_CONST:
+        case OP_VAR:
+        case OP_PARAM:
+            return 0;
+        case OP_NEG:
+        case OP_SIN:
+        case OP_COS:
+        case OP_ABS:
+        case OP_LOG:
+        case OP_POLY:
+            return 1;
+        default:
+            return 2;
+    }
+}
+
+static unsigned int hash_node(Node n) {
+    unsigned int bits[2];
+    memcpy(bits, &n.value, sizeof(bits));
+
+    unsigned int h = n.op * 2654435761u;
+    h ^= n.a    + 0x9e3779b9u + (h << 6) + (h >> 2);
+    h ^= n.b    + 0x9e3779b9u + (h << 6) + (h >> 2);
+    h ^= bits[0] + 0x9e3779b9u + (h << 6) + (h >> 2);
+    h ^= bits[1] + 0x9e3779b9u + (h << 6) + (h >> 2);
+    h ^= n.slot + 0x9e3779b9u + (h << 6) + (h >> 2);
+    h ^= n.table + 0x9e3779b9u + (h << 6) + (h >> 2);
+    return h;
+}
+static bool same_node(Node x, Node y) {
+    // compare constants bitwise so 0 and -0 stay apart
+    return x.op == y.op && x.a == y.a && x.b == y.b && x.slot == y.slot &&
+           x.table == y.table && x.degree == y.degree &&
+           !memcmp(&x.value, &y.value, sizeof(Complex));
+}
+
+static Complex fold(Opcode op, Complex l, Complex r) {
+    switch (op) {
+        case OP_ADD: return complex_add(l, r);
+        case OP_SUB: return complex_sub(l, r);
+        case OP_MUL: return complex_mul(l, r);
+        case OP_DIV: return complex_div(l, r);
+        case OP_POW: return complex_pow(l, r);
+        case OP_NEG: return complex_sub((Complex){ 0.0f, 0.0f }, l);
+        case OP_SIN: return complex_sin(l);
+        case OP_COS: return complex_cos(l);
+        case OP_ABS: return complex_mag(l);
+        case OP_LOG: return complex_log(l);
+        default:
+            printf("Can't fold %s.\n", opcode_to_str(op));
+            exit(EXIT_FAILURE);
+    }
+}
+
+static void grow_table(Dag *dag) {
+    unsigned int size = dag->table_size ? dag->table_size * 2 : 64;
+    unsigned int *table = malloc(size * sizeof(unsigned int));
+    for (unsigned int i = 0; i < size; ++i) table[i] = NO_NODE;
+
+    for (unsigned int i = 0; i < dag->count; ++i) {
+        unsigned int h = hash_node(dag->nodes[i]) & (size - 1);
+        while (table[h] != NO_NODE) h = (h + 1) & (size - 1);
+        table[h] = i;
+    }
+    free(dag->table);
+    dag->table = table;
+    dag->table_size = size;
+}
+
+unsigned int dag_node(Dag *dag, Node n) {
+    // constant operands give a constant result
+    unsigned int ar = arity(n.op);
+    if (n.op == OP_POLY && dag->nodes[n.a].op == OP_CONST) {
+        Complex v = complex_poly(dag->coefficients + n.table, n.degree, dag->nodes[n.a].value);
+        n = (Node){ OP_CONST, NO_NODE, NO_NODE, v, 0 };
+    } else if (ar > 0 && dag->nodes[n.a].op == OP_CONST && (ar == 1 || dag->nodes[n.b].op == OP_CONST)) {
+        Complex r = ar == 2 ? dag->nodes[n.b].value : (Complex){ 0.0f, 0.0f };
+        n = (Node){ OP_CONST, NO_NODE, NO_NODE, fold(n.op, dag->nodes[n.a].value, r), 0 };
+    }
+
+    if (dag->count * 2 >= dag->table_size) grow_table(dag);
+    unsigned int h = hash_node(n) & (dag->table_size - 1);
+    while (dag->table[h] != NO_NODE) {
+        if (same_node(dag->nodes[dag->table[h]], n)) return dag->table[h];
+        h = (h + 1) & (dag->table_size - 1);
+    }
+
+    if (dag->count == dag->capacity) {
+        dag->capacity = dag->capacity ? dag->capacity * 2 : 64;
+        dag->nodes = realloc(dag->nodes, dag->capacity * sizeof(Node));
+    }
+    dag->nodes[dag->count] = n;
+    dag->table[h] = dag->count;
+    return dag->count++;
+}
+
+unsigned int dag_poly(Dag *dag, unsigned int a, const Complex *coefficients, unsigned int degree) {
+    if (dag->coefficient_count + degree + 1 > dag->coefficient_capacity) {
+        dag->coefficient_capacity = (dag->coefficient_count + degree + 1) * 2;
+        dag->coefficients = realloc(dag->coefficients, dag->coefficient_capacity * sizeof(Complex));
+    }
+    unsigned int table = dag->coefficient_count;
+    memcpy(dag->coefficients + table, coefficients, (degree + 1) * sizeof(Complex));
+    dag->coefficient_count += degree + 1;
+    return dag_node(dag, (Node){ OP_POLY, a, NO_NODE, { 0.0f, 0.0f }, 0, table, degree });
+}
+
+Dag build_dag(Bytecode bc) {
+    Dag dag = { 0 };
+    unsigned int stack[256];
+    unsigned int locals[MAX_LOCALS]; // locals just name nodes, so they disappear here
+    unsigned int sp = 0;
+    unsigned int idx = 0;
+
+    while (idx < bc.length && bc.data[idx] != OP_DONE) {
+        Opcode op = bc.data[idx];
+        Node n = { op, NO_NODE, NO_NODE, { 0.0f, 0.0f }, 0 };
+        switch (op) {
+            case OP_STORE:
+                locals[bc.data[idx + 1]] = stack[--sp];
+                idx += 2;
+                continue;
+            case OP_LOAD:
+                stack[sp++] = locals[bc.data[idx + 1]];
+                idx += 2;
+                continue;
+
+            case OP_CONST:
+                n.value = (Complex){ *((float *)(bc.data + idx + 1)), *((float *)(bc.data + idx + 1 + sizeof(float))) };
+                idx += 1 + sizeof(float) * 2;
+                break;
+            case OP_VAR:
+                ++idx;
+                break;
+            case OP_PARAM:
+                n.slot = bc.data[idx + 1];
+                idx += 2;
+                break;
+
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+            case OP_DIV:
+            case OP_POW:
+                n.b = stack[--sp];
+                n.a = stack[--sp];
+                ++idx;
+                break;
+            case OP_NEG:
+            case OP_SIN:
+            case OP_COS:
+            case OP_ABS:
+            case OP_LOG:
+                n.a = stack[--sp];
+                ++idx;
+                break;
+            case OP_POLY: {
+                unsigned int degree = bc.data[idx + 1] | bc.data[idx + 2] << 8;
+                unsigned int a = stack[--sp];
+                stack[sp++] = dag_poly(&dag, a, (const Complex *)(bc.data + idx + 3), degree);
+                idx += 3 + (degree + 1) * sizeof(Complex);
+                continue;
+            }
+
+            default:
+                printf("Unknown opcode %u.\n", bc.data[idx]);
+                exit(EXIT_FAILURE);
+        }
+        stack[sp++] = dag_node(&dag, n);
+    }
+
+    dag.outputs = malloc(sp * sizeof(unsigned int));
+    memcpy(dag.outputs, stack, sp * sizeof(unsigned int));
+    dag.output_count = sp;
+    return dag;
+}
+
+void free_dag(Dag *dag) {
+    free(dag->nodes);
+    free(dag->table);
+    free(dag->outputs);
+    free(dag->coefficients);
+    *dag = (Dag){ 0 };
+}
+
+bool *dag_varies(Dag *dag) {
+    bool *varies = malloc(dag->count * sizeof(bool));
+    for (unsigned int i = 0; i < dag->count; ++i) {
+        Node n = dag->nodes[i];
+        varies[i] = n.op == OP_VAR ||
+                    (n.a != NO_NODE && varies[n.a]) ||
+                    (n.b != NO_NODE && varies[n.b]);
+    }
+    return varies;
+}
+
+typedef struct Emitter {
+    Bytecode out;
+    unsigned int idx;
+
+    unsigned int *uses;   // how many parents (or roots) refer to each node
+    unsigned int *local;  // local slot holding a node's value, or NO_NODE
+    unsigned int locals;
+} Emitter;
+
+static void put(Emitter *e, const void *bytes, unsigned int n) {
+    if (e->idx + n > e->out.length) {
+        // tables can be bigger than the whole program so far
+        while (e->idx + n > e->out.length) e->out.length = e->out.length ? e->out.length * 2 : 256;
+        e->out.data = realloc(e->out.data, e->out.length);
+    }
+    memcpy(e->out.data + e->idx, bytes, n);
+    e->idx += n;
+}
+
+static void put_slot(Emitter *e, Opcode op, unsigned char slot) {
+    unsigned char bytes[2] = { op, slot };
+    put(e, bytes, 2);
+}
+
+static void count_uses(Dag *dag, unsigned int i, unsigned int *uses) {
+    if (uses[i]++) return; // operands already counted
+    Node n = dag->nodes[i];
+    if (n.a != NO_NODE) count_uses(dag, n.a, uses);
+    if (n.b != NO_NODE) count_uses(dag, n.b, uses);
+}
+
+static void emit_node(Dag *dag, unsigned int i, Emitter *e) {
+    if (e->local[i] != NO_NODE) {
+        put_slot(e, OP_LOAD, e->local[i]);
+        return;
+    }
+
+    Node n = dag->nodes[i];
+    if (n.a != NO_NODE) emit_node(dag, n.a, e);
+    if (n.b != NO_NODE) emit_node(dag, n.b, e);
+
+    unsigned char op = n.op;
+    put(e, &op, 1);
+    if (n.op == OP_CONST) {
+        put(e, &n.value.real, sizeof(float));
+        put(e, &n.value.imag, sizeof(float));
+    }
+    if (n.op == OP_PARAM) put(e, &n.slot, 1);
+    if (n.op == OP_POLY) {
+        unsigned char degree[2] = { n.degree & 0xff, n.degree >> 8 };
+        put(e, degree, 2);
+        put(e, dag->coefficients + n.table, (n.degree + 1) * sizeof(Complex));
+    }
+
+    // computed values used more than once are kept in a local
+    if (e->uses[i] > 1 && arity(n.op) > 0 && e->locals < MAX_LOCALS) {
+        e->local[i] = e->locals++;
+        put_slot(e, OP_STORE, e->local[i]);
+        put_slot(e, OP_LOAD, e->local[i]);
+    }
+}
+
+Bytecode emit_dag(Dag *dag, const unsigned int *roots, unsigned int n) {
+    Emitter e = { { 0, NULL }, 0 };
+    e.uses = calloc(dag->count, sizeof(unsigned int));
+    e.local = malloc(dag->count * sizeof(unsigned int));
+    for (unsigned int i = 0; i < dag->count; ++i) e.local[i] = NO_NODE;
+
+    for (unsigned int i = 0; i < n; ++i) count_uses(dag, roots[i], e.uses);
+    for (unsigned int i = 0; i < n; ++i) emit_node(dag, roots[i], &e);
+
+    unsigned char done = OP_DONE;
+    put(&e, &done, 1);
+    e.out.length = e.idx;
+
+    free(e.uses);
+    free(e.local);
+    return e.out;
+}
@@ -0,0 +1,44 @@
+#ifndef DAG_H
+#define DAG_H
+
+#include "backend.h"
+
+#define NO_NODE 0xffffffffu
+
+typedef struct Node {
+    Opcode op;
+    unsigned int a, b;  // operands, NO_NODE if unused
+    Complex value;      // OP_CONST
+    unsigned char slot; // OP_PARAM
+    unsigned int table, degree; // OP_POLY: its coefficients are dag->coefficients[table...table + degree]
+} Node;
+
+// Expression DAG rebuilt from bytecode. Nodes are stored after their
+// operands, so index order is a valid evaluation order.
+typedef struct Dag {
+    Node *nodes;
+    unsigned int count, capacity;
+
+    unsigned int *table; // hash table of node indices, for sharing
+    unsigned int table_size;
+
+    unsigned int *outputs; // one root per value the program leaves on the stack
+    unsigned int output_count;
+
+    Complex *coefficients; // every OP_POLY's table, back to back
+    unsigned int coefficient_count, coefficient_capacity;
+} Dag;
+
+unsigned int arity(Opcode op);
+
+Dag build_dag(Bytecode bc);
+void free_dag(Dag *dag);
+unsigned int dag_node(Dag *dag, Node n); // Add a node, or find an equal one. Folds constants.
+// An OP_POLY of a with a copy of the given coefficients, lowest first. degree < 65536.
+unsigned int dag_poly(Dag *dag, unsigned int a, const Complex *coefficients, unsigned int degree);
+bool *dag_varies(Dag *dag);              // Which nodes depend on z. Caller frees.
+
+// Emit code that leaves the value of each root on the stack, in order.
+Bytecode emit_dag(Dag *dag, const unsigned int *roots, unsigned int n);
+
+#endif
@@ -0,0 +1,141 @@
+#include "derive.h"
+
+// Node constructors that skip the trivial terms the chain rule is full of
+
+static bool is_const(Dag *d, unsigned int i, float real) {
+    Node n = d->nodes[i];
+    return n.op == OP_CONST && n.value.real == real && n.value.imag == 0.0f;
+}
+static unsigned int konst(Dag *d, float real) {
+    return dag_node(d, (Node){ OP_CONST, NO_NODE, NO_NODE, { real, 0.0f }, 0 });
+}
+static unsigned int unop(Dag *d, Opcode op, unsigned int a) {
+    return dag_node(d, (Node){ op, a, NO_NODE, { 0.0f, 0.0f }, 0 });
+}
+static unsigned int binop(Dag *d, Opcode op, unsigned int a, unsigned int b) {
+    return dag_node(d, (Node){ op, a, b, { 0.0f, 0.0f }, 0 });
+}
+
+static unsigned int add(Dag *d, unsigned int a, unsigned int b) {
+    if (is_const(d, a, 0.0f)) return b;
+    if (is_const(d, b, 0.0f)) return a;
+    return binop(d, OP_ADD, a, b);
+}
+static unsigned int neg(Dag *d, unsigned int a) {
+    if (is_const(d, a, 0.0f)) return a;
+    return unop(d, OP_NEG, a);
+}
+static unsigned int sub(Dag *d, unsigned int a, unsigned int b) {
+    if (is_const(d, b, 0.0f)) return a;
+    if (is_const(d, a, 0.0f)) return neg(d, b);
+    return binop(d, OP_SUB, a, b);
+}
+static unsigned int mul(Dag *d, unsigned int a, unsigned int b) {
+    if (is_const(d, a, 0.0f) || is_const(d, b, 0.0f)) return konst(d, 0.0f);
+    if (is_const(d, a, 1.0f)) return b;
+    if (is_const(d, b, 1.0f)) return a;
+    return binop(d, OP_MUL, a, b);
+}
+static unsigned int quo(Dag *d, unsigned int a, unsigned int b) {
+    if (is_const(d, a, 0.0f)) return a;
+    if (is_const(d, b, 1.0f)) return a;
+    return binop(d, OP_DIV, a, b);
+}
+
+unsigned int dag_derive(Dag *dag, unsigned int i, unsigned int *memo) {
+    if (memo[i] != NO_NODE) return memo[i];
+
+    Node n = dag->nodes[i];
+    unsigned int da = n.a != NO_NODE ? dag_derive(dag, n.a, memo) : NO_NODE;
+    unsigned int db = n.b != NO_NODE ? dag_derive(dag, n.b, memo) : NO_NODE;
+    unsigned int d;
+
+    switch (n.op) {
+        case OP_CONST:
+        case OP_PARAM:
+            d = konst(dag, 0.0f);
+            break;
+        case OP_VAR:
+            d = konst(dag, 1.0f);
+            break;
+
+        case OP_ADD: d = add(dag, da, db); break;
+        case OP_SUB: d = sub(dag, da, db); break;
+        case OP_NEG: d = neg(dag, da);     break;
+        case OP_MUL:
+            d = add(dag, mul(dag, da, n.b), mul(dag, n.a, db));
+            break;
+        case OP_DIV:
+            // (a/b)' = (a' - (a/b) b') / b, reusing a/b itself
+            d = quo(dag, sub(dag, da, mul(dag, i, db)), n.b);
+            break;
+
+        case OP_SIN:
+            d = mul(dag, unop(dag, OP_COS, n.a), da);
+            break;
+        case OP_COS:
+            d = neg(dag, mul(dag, unop(dag, OP_SIN, n.a), da));
+            break;
+        case OP_LOG:
+            d = quo(dag, da, n.a);
+            break;
+        case OP_POLY: {
+            // p(a)' = p'(a) a'
+            if (!n.degree) {
+                d = konst(dag, 0.0f);
+                break;
+            }
+            Complex *c = malloc(n.degree * sizeof(Complex));
+            for (unsigned int k = 1; k <= n.degree; ++k) {
+                Complex ck = dag->coefficients[n.table + k];
+                c[k - 1] = (Complex){ ck.real * k, ck.imag * k };
+            }
+            d = mul(dag, dag_poly(dag, n.a, c, n.degree - 1), da);
+            free(c);
+            break;
+        }
+
+        case OP_POW:
+            if (is_const(dag, db, 0.0f)) {
+                // constant exponent: b a^(b-1) a'
+                unsigned int lowered = binop(dag, OP_POW, n.a, sub(dag, n.b, konst(dag, 1.0f)));
+                d = mul(dag, mul(dag, n.b, lowered), da);
+            } else {
+                // a^b (b' log(a) + b a'/a)
+                unsigned int inner = add(dag, mul(dag, db, unop(dag, OP_LOG, n.a)),
+                                              quo(dag, mul(dag, n.b, da), n.a));
+                d = mul(dag, i, inner);
+            }
+            break;
+
+        case OP_ABS:
+            printf("Can't differentiate |...|, it isn't holomorphic.\n");
+            exit(EXIT_FAILURE);
+        default:
+            printf("Can't differentiate %s.\n", opcode_to_str(n.op));
+            exit(EXIT_FAILURE);
+    }
+
+    memo[i] = d;
+    return d;
+}
+
+Bytecode derive(Bytecode bc) {
+    Dag dag = build_dag(bc);
+    unsigned int n = dag.output_count;
+
+    unsigned int *memo = malloc(dag.count * sizeof(unsigned int));
+    for (unsigned int i = 0; i < dag.count; ++i) memo[i] = NO_NODE;
+
+    unsigned int *roots = malloc(2 * n * sizeof(unsigned int));
+    for (unsigned int i = 0; i < n; ++i) {
+        roots[i] = dag.outputs[i];
+        roots[n + i] = dag_derive(&dag, dag.outputs[i], memo);
+    }
+    Bytecode out = emit_dag(&dag, roots, 2 * n);
+
+    free(roots);
+    free(memo);
+    free_dag(&dag);
+    return out;
+}
@@ -0,0 +1,13 @@
+#ifndef DERIVE_H
+#define DERIVE_H
+
+#include "dag.h"
+
+// Node for d/dz of node, added to the same DAG. memo has one entry per
+// node that existed before the first call, all NO_NODE to start with.
+unsigned int dag_derive(Dag *dag, unsigned int node, unsigned int *memo);
+
+// From a program computing f1..fn, build one computing f1..fn, f1'..fn'.
+Bytecode derive(Bytecode bc);
+
+#endif
@@ -0,0 +1,73 @@
+#include "fft.h"
+#include <math.h>
+#include <stdlib.h>
+
+static Wide mul(Wide a, Wide b) {
+    return (Wide){ a.real * b.real - a.imag * b.imag, a.real * b.imag + a.imag * b.real };
+}
+
+static void radix2(Wide *x, unsigned int n, int sign) {
+    for (unsigned int i = 1, j = 0; i < n; ++i) {
+        unsigned int bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            Wide t = x[i];
+            x[i] = x[j];
+            x[j] = t;
+        }
+    }
+
+    // twiddles straight from cos and sin, not by repeated multiplication
+    Wide *w = malloc((n / 2 + 1) * sizeof(Wide));
+    for (unsigned int k = 0; k < n / 2; ++k)
+        w[k] = (Wide){ cos(2 * M_PI * k / n), sign * sin(2 * M_PI * k / n) };
+
+    for (unsigned int len = 2; len <= n; len <<= 1) {
+        unsigned int stride = n / len;
+        for (unsigned int i = 0; i < n; i += len)
+            for (unsigned int k = 0; k < len / 2; ++k) {
+                Wide u = x[i + k], v = mul(x[i + k + len / 2], w[k * stride]);
+                x[i + k] = (Wide){ u.real + v.real, u.imag + v.imag };
+                x[i + k + len / 2] = (Wide){ u.real - v.real, u.imag - v.imag };
+            }
+    }
+    free(w);
+}
+
+// jk = (j^2 + k^2 - (j - k)^2) / 2 turns the transform into a convolution
+// with the chirp e^(sign pi i m^2 / n), done by power of two transforms
+static void bluestein(Wide *x, unsigned int n, int sign) {
+    unsigned int m = 1;
+    while (m < 2 * n - 1) m <<= 1;
+
+    Wide *chirp = malloc(n * sizeof(Wide));
+    for (unsigned long k = 0; k < n; ++k) {
+        double angle = M_PI * (double)(k * k % (2ul * n)) / n;
+        chirp[k] = (Wide){ cos(angle), sign * sin(angle) };
+    }
+
+    Wide *a = calloc(m, sizeof(Wide)), *b = calloc(m, sizeof(Wide));
+    for (unsigned int k = 0; k < n; ++k) a[k] = mul(x[k], chirp[k]);
+    b[0] = (Wide){ chirp[0].real, -chirp[0].imag };
+    for (unsigned int k = 1; k < n; ++k) b[k] = b[m - k] = (Wide){ chirp[k].real, -chirp[k].imag };
+
+    radix2(a, m, -1);
+    radix2(b, m, -1);
+    for (unsigned int k = 0; k < m; ++k) a[k] = mul(a[k], b[k]);
+    radix2(a, m, 1);
+    for (unsigned int k = 0; k < n; ++k) {
+        Wide c = mul(a[k], chirp[k]);
+        x[k] = (Wide){ c.real / m, c.imag / m };
+    }
+
+    free(b);
+    free(a);
+    free(chirp);
+}
+
+void fft(Wide *x, unsigned int n, int sign) {
+    if (n < 2) return;
+    if (!(n & (n - 1))) radix2(x, n, sign);
+    else bluestein(x, n, sign);
+}
@@ -0,0 +1,13 @@
+#ifndef FFT_H
+#define FFT_H
+
+// Complex in double, for sums that would lose too much in float
+typedef struct Wide {
+    double real, imag;
+} Wide;
+
+// In place, x[j] = sum over k of x[k] e^(sign 2 pi i j k / n), for sign 1 or -1.
+// Radix 2 when n is a power of two, otherwise Bluestein's chirp z.
+void fft(Wide *x, unsigned int n, int sign);
+
+#endif
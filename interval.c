@@ -0,0 +1,240 @@
+#include "interval.h"
+#include <math.h>
+
+#define PI 3.14159265358979323846f
+
+static const Interval EVERYTHING = { -INFINITY, INFINITY };
+
+static Interval point(float x) {
+    return (Interval){ x, x };
+}
+// inf - inf and 0 * inf mean we lost track, so give up on that interval
+static Interval checked(Interval a) {
+    return isnan(a.lo) || isnan(a.hi) ? EVERYTHING : a;
+}
+static bool contains(Interval a, float x) {
+    return a.lo <= x && x <= a.hi;
+}
+
+static Interval iadd(Interval a, Interval b) {
+    return checked((Interval){ a.lo + b.lo, a.hi + b.hi });
+}
+static Interval isub(Interval a, Interval b) {
+    return checked((Interval){ a.lo - b.hi, a.hi - b.lo });
+}
+static Interval ineg(Interval a) {
+    return (Interval){ -a.hi, -a.lo };
+}
+static Interval imul(Interval a, Interval b) {
+    float p[4] = { a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi };
+    Interval r = { p[0], p[0] };
+    for (unsigned int i = 1; i < 4; ++i) {
+        r.lo = fminf(r.lo, p[i]);
+        r.hi = fmaxf(r.hi, p[i]);
+        if (isnan(p[i])) return EVERYTHING;
+    }
+    return isnan(p[0]) ? EVERYTHING : r;
+}
+static Interval isqr(Interval a) {
+    if (a.lo >= 0) return (Interval){ a.lo * a.lo, a.hi * a.hi };
+    if (a.hi <= 0) return (Interval){ a.hi * a.hi, a.lo * a.lo };
+    float m = fmaxf(-a.lo, a.hi);
+    return (Interval){ 0, m * m };
+}
+// b must be strictly positive
+static Interval idiv_positive(Interval a, Interval b) {
+    return imul(a, (Interval){ 1 / b.hi, 1 / b.lo });
+}
+static Interval iexp(Interval a) {
+    return (Interval){ expf(a.lo), expf(a.hi) };
+}
+static Interval ilog_positive(Interval a) {
+    return (Interval){ logf(a.lo), logf(a.hi) };
+}
+static Interval isinh(Interval a) {
+    return (Interval){ sinhf(a.lo), sinhf(a.hi) };
+}
+static Interval icosh(Interval a) {
+    if (contains(a, 0)) return (Interval){ 1, coshf(fmaxf(-a.lo, a.hi)) };
+    float near = fminf(fabsf(a.lo), fabsf(a.hi)), far = fmaxf(fabsf(a.lo), fabsf(a.hi));
+    return (Interval){ coshf(near), coshf(far) };
+}
+static Interval icos(Interval a) {
+    if (!(a.hi - a.lo < 2 * PI)) return (Interval){ -1, 1 }; // also catches infinities
+    float c0 = cosf(a.lo), c1 = cosf(a.hi);
+    Interval r = { fminf(c0, c1), fmaxf(c0, c1) };
+    // maxima at 2k pi, minima at (2k + 1) pi
+    if (ceilf(a.lo / (2 * PI)) * 2 * PI <= a.hi) r.hi = 1;
+    if (ceilf((a.lo - PI) / (2 * PI)) * 2 * PI + PI <= a.hi) r.lo = -1;
+    return r;
+}
+static Interval isin(Interval a) {
+    return icos((Interval){ a.lo - PI / 2, a.hi - PI / 2 });
+}
+
+static Box bpoint(Complex c) {
+    return (Box){ point(c.real), point(c.imag) };
+}
+static Box badd(Box a, Box b) {
+    return (Box){ iadd(a.real, b.real), iadd(a.imag, b.imag) };
+}
+static Box bsub(Box a, Box b) {
+    return (Box){ isub(a.real, b.real), isub(a.imag, b.imag) };
+}
+static Box bneg(Box a) {
+    return (Box){ ineg(a.real), ineg(a.imag) };
+}
+static Box bmul(Box a, Box b) {
+    return (Box){
+        isub(imul(a.real, b.real), imul(a.imag, b.imag)),
+        iadd(imul(a.real, b.imag), imul(a.imag, b.real))
+    };
+}
+static Box bdiv(Box a, Box b) {
+    // a/b = a conj(b) / |b|^2
+    Interval denominator = iadd(isqr(b.real), isqr(b.imag));
+    if (!(denominator.lo > 0)) return (Box){ EVERYTHING, EVERYTHING };
+    Interval real = iadd(imul(a.real, b.real), imul(a.imag, b.imag));
+    Interval imag = isub(imul(a.imag, b.real), imul(a.real, b.imag));
+    return (Box){ idiv_positive(real, denominator), idiv_positive(imag, denominator) };
+}
+static Box bsin(Box a) {
+    // sin(x + iy) = sin x cosh y + i cos x sinh y
+    return (Box){ imul(isin(a.real), icosh(a.imag)), imul(icos(a.real), isinh(a.imag)) };
+}
+static Box bcos(Box a) {
+    // cos(x + iy) = cos x cosh y - i sin x sinh y
+    return (Box){ imul(icos(a.real), icosh(a.imag)), ineg(imul(isin(a.real), isinh(a.imag))) };
+}
+static Box bexp(Box a) {
+    Interval r = iexp(a.real);
+    return (Box){ imul(r, icos(a.imag)), imul(r, isin(a.imag)) };
+}
+static Interval bmodulus(Box a) {
+    // nearest point of the box to 0, and the farthest corner
+    float nx = contains(a.real, 0) ? 0 : fminf(fabsf(a.real.lo), fabsf(a.real.hi));
+    float ny = contains(a.imag, 0) ? 0 : fminf(fabsf(a.imag.lo), fabsf(a.imag.hi));
+    float fx = fmaxf(fabsf(a.real.lo), fabsf(a.real.hi));
+    float fy = fmaxf(fabsf(a.imag.lo), fabsf(a.imag.hi));
+    return (Interval){ sqrtf(nx * nx + ny * ny), sqrtf(fx * fx + fy * fy) };
+}
+static Box blog(Box a) {
+    Interval modulus = bmodulus(a);
+    Interval real = modulus.lo > 0 ? ilog_positive(modulus) : (Interval){ -INFINITY, logf(modulus.hi) };
+
+    // the principal branch jumps across the negative real axis
+    if (a.real.lo <= 0 && contains(a.imag, 0)) return (Box){ real, { -PI, PI } };
+
+    // otherwise arg is continuous on the box, and extreme at its corners
+    float args[4] = {
+        atan2f(a.imag.lo, a.real.lo), atan2f(a.imag.lo, a.real.hi),
+        atan2f(a.imag.hi, a.real.lo), atan2f(a.imag.hi, a.real.hi)
+    };
+    Interval imag = { args[0], args[0] };
+    for (unsigned int i = 1; i < 4; ++i) {
+        imag.lo = fminf(imag.lo, args[i]);
+        imag.hi = fmaxf(imag.hi, args[i]);
+    }
+    return (Box){ real, imag };
+}
+static Box bpow(Box a, Box b) {
+    // small integer powers by multiplication are much tighter than exp(b log a)
+    float n = b.real.lo;
+    if (b.real.lo == b.real.hi && b.imag.lo == 0 && b.imag.hi == 0 && n == floorf(n) && fabsf(n) <= 16) {
+        Box r = bpoint((Complex){ 1.0f, 0.0f });
+        for (int i = 0; i < (int)fabsf(n); ++i) r = bmul(r, a);
+        return n < 0 ? bdiv(bpoint((Complex){ 1.0f, 0.0f }), r) : r;
+    }
+    return bexp(bmul(b, blog(a)));
+}
+
+// Slots [first, first + count) read boxes instead of params
+static Box exec_box(Bytecode bc, Box z, const Complex *params, const Box *boxes, unsigned int first, unsigned int count) {
+    Box stack[256];
+    Box locals[MAX_LOCALS];
+    unsigned int sp = 0;
+    unsigned int idx = 0;
+    Box l, r;
+    while (idx < bc.length) {
+        switch (bc.data[idx]) {
+            case OP_CONST:
+                stack[sp++] = bpoint((Complex){ *((float *)(bc.data + idx + 1)), *((float *)(bc.data + idx + 1 + sizeof(float))) });
+                idx += 1 + sizeof(float) * 2;
+                break;
+            case OP_VAR:
+                stack[sp++] = z;
+                ++idx;
+                break;
+            case OP_PARAM:
+                stack[sp++] = bc.data[idx + 1] - first < count ? boxes[bc.data[idx + 1] - first]
+                                                               : bpoint(params[bc.data[idx + 1]]);
+                idx += 2;
+                break;
+            case OP_STORE:
+                locals[bc.data[idx + 1]] = stack[--sp];
+                idx += 2;
+                break;
+            case OP_LOAD:
+                stack[sp++] = locals[bc.data[idx + 1]];
+                idx += 2;
+                break;
+
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+            case OP_DIV:
+            case OP_POW:
+                r = stack[--sp];
+                l = stack[--sp];
+                switch (bc.data[idx]) {
+                    case OP_ADD: stack[sp++] = badd(l, r); break;
+                    case OP_SUB: stack[sp++] = bsub(l, r); break;
+                    case OP_MUL: stack[sp++] = bmul(l, r); break;
+                    case OP_DIV: stack[sp++] = bdiv(l, r); break;
+                    default:     stack[sp++] = bpow(l, r); break;
+                }
+                ++idx;
+                break;
+
+            case OP_NEG: stack[sp - 1] = bneg(stack[sp - 1]); ++idx; break;
+            case OP_SIN: stack[sp - 1] = bsin(stack[sp - 1]); ++idx; break;
+            case OP_COS: stack[sp - 1] = bcos(stack[sp - 1]); ++idx; break;
+            case OP_LOG: stack[sp - 1] = blog(stack[sp - 1]); ++idx; break;
+            case OP_POLY: {
+                unsigned int degree = bc.data[idx + 1] | bc.data[idx + 2] << 8;
+                const Complex *c = (const Complex *)(bc.data + idx + 3);
+                Box x = stack[sp - 1];
+                Box p = bpoint(c[degree]);
+                for (unsigned int k = degree; k-- > 0;) p = badd(bmul(p, x), bpoint(c[k]));
+                stack[sp - 1] = p;
+                idx += 3 + (degree + 1) * sizeof(Complex);
+                break;
+            }
+            case OP_ABS:
+                stack[sp - 1] = (Box){ bmodulus(stack[sp - 1]), point(0) };
+                ++idx;
+                break;
+
+            case OP_DONE:
+                return stack[sp - 1];
+
+            default: printf("UNKNOWN\n"); return (Box){ EVERYTHING, EVERYTHING };
+        }
+    }
+    return stack[sp - 1];
+}
+
+Box run_box(Bytecode bc, Box z, const Complex *params) {
+    return exec_box(bc, z, params, NULL, 0, 0);
+}
+
+Box kernel_box(Kernel k, Box z, const Complex *slots) {
+    Box boxes[MAX_SEPARABLE];
+    for (unsigned int j = 0; j < k.separable_count; ++j) {
+        Separable s = k.separable[j];
+        Box u = badd(bmul(bpoint(slots[s.alpha]), z), bpoint(slots[s.beta]));
+        boxes[j] = s.op == OP_SIN ? bsin(u) : s.op == OP_COS ? bcos(u) : bexp(u);
+    }
+    unsigned int first = k.separable_count ? k.separable[0].slot : 0;
+    return exec_box(k.body, z, slots, boxes, first, k.separable_count);
+}
@@ -0,0 +1,22 @@
+#ifndef INTERVAL_H
+#define INTERVAL_H
+
+#include "batch.h"
+
+typedef struct Interval {
+    float lo, hi;
+} Interval;
+
+// Rectangular complex interval: every z with Re(z) in real and Im(z) in imag
+typedef struct Box {
+    Interval real, imag;
+} Box;
+
+// A box containing the last output for every z in the given box. Bounds
+// can be loose, and are unbounded where the program has a pole or a
+// branch cut inside the box, but they are never too small (up to float rounding).
+Box run_box(Bytecode bc, Box z, const Complex *params);
+// The same for a hoisted kernel, with slots from kernel_slots
+Box kernel_box(Kernel k, Box z, const Complex *slots);
+
+#endif
@@ -0,0 +1,409 @@
+#include "poly.h"
+#include <math.h>
+
+#define UNKNOWN -2
+// Worth as many multiply-adds as this, since it goes through exp, log and atan2
+#define POW_COST 32
+
+// Working state for dag_polynomial. Coefficients are NO_NODE where they're zero,
+// which keeps sparse things like z^1000 cheap.
+typedef struct Expansion {
+    Dag *dag;
+    const bool *varies;
+    unsigned int max;
+    unsigned int nodes;   // how many there were to start with
+    int *degree;          // per node, UNKNOWN until worked out, -1 if not a polynomial
+    unsigned int **terms; // per node, degree + 1 coefficients
+} Expansion;
+
+static bool is_zero(Dag *d, unsigned int i) {
+    if (i == NO_NODE) return true;
+    Node n = d->nodes[i];
+    return n.op == OP_CONST && n.value.real == 0.0f && n.value.imag == 0.0f;
+}
+static unsigned int konst(Dag *d, Complex c) {
+    return dag_node(d, (Node){ OP_CONST, NO_NODE, NO_NODE, c, 0 });
+}
+static unsigned int binop(Dag *d, Opcode op, unsigned int a, unsigned int b) {
+    return dag_node(d, (Node){ op, a, b, { 0.0f, 0.0f }, 0 });
+}
+static unsigned int add(Dag *d, unsigned int a, unsigned int b) {
+    if (is_zero(d, a)) return b;
+    if (is_zero(d, b)) return a;
+    return binop(d, OP_ADD, a, b);
+}
+static unsigned int mul(Dag *d, unsigned int a, unsigned int b) {
+    if (is_zero(d, a) || is_zero(d, b)) return NO_NODE;
+    return binop(d, OP_MUL, a, b);
+}
+
+static int expand(Expansion *e, unsigned int i);
+
+// Product of two expansions, or NULL if it's over the maximum degree
+static unsigned int *convolve(Expansion *e, const unsigned int *a, int da, const unsigned int *b, int db) {
+    if (da + db > (int)e->max) return NULL;
+    unsigned int *out = malloc((da + db + 1) * sizeof(unsigned int));
+    for (int k = 0; k <= da + db; ++k) out[k] = NO_NODE;
+    for (int i = 0; i <= da; ++i) {
+        if (is_zero(e->dag, a[i])) continue;
+        for (int j = 0; j <= db; ++j)
+            out[i + j] = add(e->dag, out[i + j], mul(e->dag, a[i], b[j]));
+    }
+    return out;
+}
+
+static unsigned int *power(Expansion *e, unsigned int base, unsigned int n, int *degree) {
+    int db = expand(e, base);
+    if (db < 0 || (unsigned long)db * n > e->max) return NULL;
+
+    // by squaring
+    unsigned int *r = malloc(sizeof(unsigned int));
+    r[0] = konst(e->dag, (Complex){ 1.0f, 0.0f });
+    unsigned int *square = malloc((db + 1) * sizeof(unsigned int));
+    memcpy(square, e->terms[base], (db + 1) * sizeof(unsigned int));
+    int d = 0, ds = db;
+    while (true) {
+        if (n & 1) {
+            unsigned int *next = convolve(e, r, d, square, ds);
+            free(r);
+            r = next;
+            d += ds;
+        }
+        n >>= 1;
+        if (!n) break;
+        unsigned int *next = convolve(e, square, ds, square, ds);
+        free(square);
+        square = next;
+        ds *= 2;
+    }
+    free(square);
+    *degree = d;
+    return r;
+}
+
+static int expand(Expansion *e, unsigned int i) {
+    if (e->degree[i] != UNKNOWN) return e->degree[i];
+    Dag *dag = e->dag;
+    Node n = dag->nodes[i];
+    unsigned int *t = NULL;
+    int d = -1;
+
+    if (!e->varies[i]) {
+        t = malloc(sizeof(unsigned int));
+        t[0] = i;
+        d = 0;
+    } else switch (n.op) {
+        case OP_VAR:
+            if (e->max < 1) break;
+            t = malloc(2 * sizeof(unsigned int));
+            t[0] = NO_NODE;
+            t[1] = konst(dag, (Complex){ 1.0f, 0.0f });
+            d = 1;
+            break;
+        case OP_ADD:
+        case OP_SUB: {
+            int da = expand(e, n.a), db = expand(e, n.b);
+            if (da < 0 || db < 0) break;
+            d = da > db ? da : db;
+            t = malloc((d + 1) * sizeof(unsigned int));
+            for (int k = 0; k <= d; ++k) {
+                unsigned int a = k <= da ? e->terms[n.a][k] : NO_NODE;
+                unsigned int b = k <= db ? e->terms[n.b][k] : NO_NODE;
+                if (n.op == OP_ADD) t[k] = add(dag, a, b);
+                else if (is_zero(dag, b)) t[k] = a;
+                else t[k] = is_zero(dag, a) ? binop(dag, OP_NEG, b, NO_NODE) : binop(dag, OP_SUB, a, b);
+            }
+            break;
+        }
+        case OP_NEG:
+        case OP_DIV:
+            if (n.op == OP_DIV && e->varies[n.b]) break;
+            d = expand(e, n.a);
+            if (d < 0) break;
+            t = malloc((d + 1) * sizeof(unsigned int));
+            for (int k = 0; k <= d; ++k)
+                t[k] = is_zero(dag, e->terms[n.a][k]) ? NO_NODE : binop(dag, n.op, e->terms[n.a][k], n.b);
+            break;
+        case OP_MUL: {
+            int da = expand(e, n.a), db = expand(e, n.b);
+            if (da < 0 || db < 0) break;
+            t = convolve(e, e->terms[n.a], da, e->terms[n.b], db);
+            d = t ? da + db : -1;
+            break;
+        }
+        case OP_POW: {
+            // whole powers that are written as constants
+            Node b = dag->nodes[n.b];
+            if (b.op != OP_CONST || b.value.imag != 0.0f || b.value.real < 0.0f ||
+                b.value.real != floorf(b.value.real) || b.value.real > e->max) break;
+            t = power(e, n.a, (unsigned int)b.value.real, &d);
+            if (!t) d = -1;
+            break;
+        }
+        case OP_POLY: {
+            const Complex *c = dag->coefficients + n.table;
+            if (dag->nodes[n.a].op == OP_VAR) {
+                if (n.degree > e->max) break;
+                d = n.degree;
+                t = malloc((d + 1) * sizeof(unsigned int));
+                for (int k = 0; k <= d; ++k)
+                    t[k] = c[k].real == 0.0f && c[k].imag == 0.0f ? NO_NODE : konst(dag, c[k]);
+                break;
+            }
+
+            // Horner, with the argument's expansion in place of z
+            int da = expand(e, n.a);
+            if (da < 0 || (unsigned long)da * n.degree > e->max) break;
+            t = malloc(sizeof(unsigned int));
+            t[0] = konst(dag, c[n.degree]);
+            d = 0;
+            for (unsigned int k = n.degree; k-- > 0;) {
+                unsigned int *next = convolve(e, t, d, e->terms[n.a], da);
+                free(t);
+                t = next;
+                d += da;
+                t[0] = add(dag, t[0], konst(dag, c[k]));
+            }
+            break;
+        }
+        default:
+            break;
+    }
+
+    // cancellation can leave zeros on top
+    while (d > 0 && is_zero(dag, t[d])) --d;
+    e->degree[i] = d;
+    e->terms[i] = t;
+    return d;
+}
+
+static Expansion start_expansion(Dag *dag, const bool *varies, unsigned int max_degree) {
+    Expansion e = { dag, varies, max_degree, dag->count, NULL, NULL };
+    e.degree = malloc(e.nodes * sizeof(int));
+    e.terms = calloc(e.nodes, sizeof(unsigned int *));
+    for (unsigned int i = 0; i < e.nodes; ++i) e.degree[i] = UNKNOWN;
+    return e;
+}
+
+static void end_expansion(Expansion *e) {
+    for (unsigned int i = 0; i < e->nodes; ++i) free(e->terms[i]);
+    free(e->terms);
+    free(e->degree);
+}
+
+int dag_polynomial(Dag *dag, unsigned int node, const bool *varies, unsigned int max_degree, unsigned int *coefficients) {
+    Expansion e = start_expansion(dag, varies, max_degree);
+    int d = expand(&e, node);
+    unsigned int zero = konst(dag, (Complex){ 0.0f, 0.0f });
+    for (int k = 0; k <= d; ++k)
+        coefficients[k] = e.terms[node][k] == NO_NODE ? zero : e.terms[node][k];
+    end_expansion(&e);
+    return d;
+}
+
+int polynomial_coefficients(Bytecode bc, const Complex *params, unsigned int max_degree, Complex *coefficients) {
+    Dag dag = build_dag(bc);
+    bool *varies = dag_varies(&dag);
+    unsigned int *terms = malloc((max_degree + 1) * sizeof(unsigned int));
+    int d = dag_polynomial(&dag, dag.outputs[dag.output_count - 1], varies, max_degree, terms);
+
+    // constants as they are, and the rest by running them, a stackful at a time
+    unsigned int *pending = malloc((max_degree + 1) * sizeof(unsigned int)), *at = malloc((max_degree + 1) * sizeof(unsigned int));
+    unsigned int count = 0;
+    for (int k = 0; k <= d; ++k) {
+        if (dag.nodes[terms[k]].op == OP_CONST) {
+            coefficients[k] = dag.nodes[terms[k]].value;
+        } else {
+            pending[count] = terms[k];
+            at[count++] = k;
+        }
+    }
+    Complex values[256];
+    for (unsigned int i = 0; i < count; i += 128) {
+        unsigned int n = count - i < 128 ? count - i : 128;
+        Bytecode program = emit_dag(&dag, pending + i, n);
+        (void) run_all(program, (Complex){ 0.0f, 0.0f }, params, values);
+        for (unsigned int j = 0; j < n; ++j) coefficients[at[i + j]] = values[j];
+        free(program.data);
+    }
+
+    free(at);
+    free(pending);
+    free(terms);
+    free(varies);
+    free_dag(&dag);
+    return d;
+}
+
+// What shape a node has, for telling monomial sums apart from things like
+// (z - 1)^20, whose expansion would lose everything near the root
+enum { SHAPE_UNKNOWN, SHAPE_MONOMIAL, SHAPE_SUM, SHAPE_OTHER };
+
+typedef struct Shapes {
+    Dag *dag;
+    const bool *varies;
+    unsigned char *shape; // per node
+    int *degree;          // per node, once its shape is known
+} Shapes;
+
+static unsigned char shape_of(Shapes *s, unsigned int i) {
+    if (s->shape[i] != SHAPE_UNKNOWN) return s->shape[i];
+    Node n = s->dag->nodes[i];
+    unsigned char shape = SHAPE_OTHER;
+    long degree = 0;
+
+    if (!s->varies[i]) {
+        shape = SHAPE_MONOMIAL;
+    } else switch (n.op) {
+        case OP_VAR:
+            shape = SHAPE_MONOMIAL;
+            degree = 1;
+            break;
+        case OP_POLY:
+            if (s->dag->nodes[n.a].op == OP_VAR) {
+                shape = SHAPE_SUM;
+                degree = n.degree;
+            }
+            break;
+        case OP_ADD:
+        case OP_SUB: {
+            unsigned char a = shape_of(s, n.a), b = shape_of(s, n.b);
+            if (a != SHAPE_OTHER && b != SHAPE_OTHER) {
+                shape = SHAPE_SUM;
+                degree = s->degree[n.a] > s->degree[n.b] ? s->degree[n.a] : s->degree[n.b];
+            }
+            break;
+        }
+        case OP_NEG:
+            shape = shape_of(s, n.a);
+            degree = s->degree[n.a];
+            break;
+        case OP_DIV:
+            if (s->varies[n.b]) break;
+            shape = shape_of(s, n.a);
+            degree = s->degree[n.a];
+            break;
+        case OP_MUL: {
+            // constant multiples of sums, and products of single terms
+            unsigned char a = shape_of(s, n.a), b = shape_of(s, n.b);
+            degree = (long)s->degree[n.a] + s->degree[n.b];
+            if (!s->varies[n.a]) shape = b;
+            else if (!s->varies[n.b]) shape = a;
+            else if (a == SHAPE_MONOMIAL && b == SHAPE_MONOMIAL) shape = SHAPE_MONOMIAL;
+            break;
+        }
+        case OP_POW: {
+            // whole powers of single terms
+            Node b = s->dag->nodes[n.b];
+            if (shape_of(s, n.a) != SHAPE_MONOMIAL || b.op != OP_CONST || b.value.imag != 0.0f ||
+                b.value.real < 0.0f || b.value.real != floorf(b.value.real) || b.value.real > MAX_POLY_DEGREE) break;
+            shape = SHAPE_MONOMIAL;
+            degree = (long)s->degree[n.a] * (long)b.value.real;
+            break;
+        }
+        default:
+            break;
+    }
+
+    if (degree > MAX_POLY_DEGREE) shape = SHAPE_OTHER;
+    s->shape[i] = shape;
+    s->degree[i] = shape == SHAPE_OTHER ? -1 : (int)degree;
+    return shape;
+}
+
+static Shapes start_shapes(Dag *dag, const bool *varies) {
+    Shapes s = { dag, varies, calloc(dag->count, 1), malloc(dag->count * sizeof(int)) };
+    return s;
+}
+
+static void end_shapes(Shapes *s) {
+    free(s->shape);
+    free(s->degree);
+}
+
+int dag_monomial_sum(Dag *dag, unsigned int node, const bool *varies) {
+    Shapes s = start_shapes(dag, varies);
+    (void) shape_of(&s, node);
+    int d = s.degree[node];
+    end_shapes(&s);
+    return d;
+}
+
+// State for dag_fuse_polynomials
+typedef struct Fusion {
+    Expansion e;
+    Shapes shapes;
+    unsigned int *replaced; // per original node, NO_NODE until visited
+    bool *counted;
+    unsigned int var;       // the OP_VAR node
+} Fusion;
+
+// Rough cost of computing node i and the varying nodes under it, each counted once
+static unsigned int cost(Fusion *f, unsigned int i) {
+    if (!f->e.varies[i] || f->counted[i]) return 0;
+    f->counted[i] = true;
+    Node n = f->e.dag->nodes[i];
+    unsigned int c = n.op == OP_POW ? POW_COST : n.op == OP_POLY ? n.degree : arity(n.op) > 0;
+    if (n.a != NO_NODE) c += cost(f, n.a);
+    if (n.b != NO_NODE) c += cost(f, n.b);
+    return c;
+}
+
+static unsigned int fuse(Fusion *f, unsigned int i) {
+    if (f->replaced[i] != NO_NODE) return f->replaced[i];
+    Dag *dag = f->e.dag;
+    Node n = dag->nodes[i];
+    unsigned int r = i;
+
+    // only sums of c z^k, which are as cheap to expand as they are to write down
+    bool candidate = f->e.varies[i] && n.op != OP_VAR && shape_of(&f->shapes, i) != SHAPE_OTHER;
+    int d = candidate ? expand(&f->e, i) : -1;
+    bool fused = false;
+    if (d >= 0) {
+        // every coefficient but the constant term has to be a constant to go in the table
+        const unsigned int *t = f->e.terms[i];
+        bool constant = true;
+        for (int k = 1; k <= d; ++k) constant = constant && (t[k] == NO_NODE || dag->nodes[t[k]].op == OP_CONST);
+
+        memset(f->counted, 0, f->e.nodes * sizeof(bool));
+        if (constant && (unsigned int)d + 1 < cost(f, i)) {
+            Complex *c = malloc((d + 1) * sizeof(Complex));
+            for (int k = 0; k <= d; ++k) c[k] = t[k] == NO_NODE ? (Complex){ 0.0f, 0.0f } : dag->nodes[t[k]].value;
+            bool constant_term = t[0] == NO_NODE || dag->nodes[t[0]].op == OP_CONST;
+            if (!constant_term) c[0] = (Complex){ 0.0f, 0.0f };
+            r = dag_poly(dag, f->var, c, d);
+            if (!constant_term && dag->nodes[t[0]].op == OP_NEG) r = binop(dag, OP_SUB, r, dag->nodes[t[0]].a);
+            else if (!constant_term) r = binop(dag, OP_ADD, r, t[0]);
+            free(c);
+            fused = true;
+        }
+    }
+    if (!fused && arity(n.op) > 0) {
+        // rebuild over the fused operands, which is the same node if nothing changed
+        n.a = fuse(f, n.a);
+        if (n.b != NO_NODE) n.b = fuse(f, n.b);
+        r = dag_node(dag, n);
+    }
+    f->replaced[i] = r;
+    return r;
+}
+
+void dag_fuse_polynomials(Dag *dag) {
+    bool *varies = dag_varies(dag);
+    Fusion f = { start_expansion(dag, varies, MAX_POLY_DEGREE), start_shapes(dag, varies), NULL, NULL, NO_NODE };
+    f.replaced = malloc(f.e.nodes * sizeof(unsigned int));
+    f.counted = malloc(f.e.nodes * sizeof(bool));
+    for (unsigned int i = 0; i < f.e.nodes; ++i) {
+        f.replaced[i] = NO_NODE;
+        if (dag->nodes[i].op == OP_VAR) f.var = i;
+    }
+
+    if (f.var != NO_NODE)
+        for (unsigned int i = 0; i < dag->output_count; ++i) dag->outputs[i] = fuse(&f, dag->outputs[i]);
+
+    free(f.counted);
+    free(f.replaced);
+    end_shapes(&f.shapes);
+    end_expansion(&f.e);
+    free(varies);
+}
@@ -0,0 +1,30 @@
+#ifndef POLY_H
+#define POLY_H
+
+#include "dag.h"
+
+#define MAX_POLY_DEGREE 4096
+
+// Coefficients of node as a polynomial in z, lowest power first, added to
+// the same DAG as nodes that don't depend on z. Returns the degree, or -1
+// if node isn't a polynomial or its degree is over max_degree.
+// coefficients needs room for max_degree + 1 entries.
+int dag_polynomial(Dag *dag, unsigned int node, const bool *varies, unsigned int max_degree, unsigned int *coefficients);
+
+// Degree of node if it's a sum of constant multiples of whole powers of z
+// (OP_POLY of z included), which dag_polynomial expands quickly and without
+// losing precision. -1 for anything else, like powers or products of sums.
+int dag_monomial_sum(Dag *dag, unsigned int node, const bool *varies);
+
+// Replace sums of c z^k with constant c (the constant term may be anything
+// that doesn't depend on z) by OP_POLY of z, wherever that's cheaper than
+// what's there. Quotients of them end up as quotients of OP_POLYs. Factored
+// forms like (z - 1)^5 stay as they are.
+void dag_fuse_polynomials(Dag *dag);
+
+// Coefficients of the last output as a polynomial in z, lowest first, worked
+// out with the given params. Returns the degree, or -1 if it isn't a polynomial
+// of degree at most max_degree. coefficients needs room for max_degree + 1.
+int polynomial_coefficients(Bytecode bc, const Complex *params, unsigned int max_degree, Complex *coefficients);
+
+#endif
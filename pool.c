@@ -0,0 +1,167 @@
+#include "pool.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Indices [begin, end) a worker hasn't started yet
+typedef struct Share {
+    pthread_mutex_t lock;
+    unsigned int begin, end;
+} Share;
+
+struct Pool {
+    unsigned int workers;
+    pthread_t *threads; // workers - 1 of them, the caller is worker 0
+    Share *shares;
+
+    pthread_mutex_t running; // one run at a time
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    unsigned long generation;
+    unsigned int busy;
+    bool quit;
+
+    Task task;
+    void *arg;
+};
+
+typedef struct Worker {
+    Pool *pool;
+    unsigned int id;
+} Worker;
+
+static bool take(Share *s, unsigned int *index) {
+    pthread_mutex_lock(&s->lock);
+    bool ok = s->begin < s->end;
+    if (ok) *index = s->begin++;
+    pthread_mutex_unlock(&s->lock);
+    return ok;
+}
+
+// Move the back half of some other worker's share into ours
+static bool steal(Pool *pool, unsigned int id) {
+    for (unsigned int i = 1; i < pool->workers; ++i) {
+        Share *victim = &pool->shares[(id + i) % pool->workers];
+        pthread_mutex_lock(&victim->lock);
+        unsigned int left = victim->end - victim->begin;
+        unsigned int begin = victim->end - (left + 1) / 2, end = victim->end;
+        victim->end = begin;
+        pthread_mutex_unlock(&victim->lock);
+
+        if (left) {
+            Share *own = &pool->shares[id];
+            pthread_mutex_lock(&own->lock);
+            own->begin = begin;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void work(Pool *pool, unsigned int id) {
+    unsigned int index;
+    do {
+        while (take(&pool->shares[id], &index))
+            pool->task(pool->arg, index, id);
+    } while (steal(pool, id));
+}
+
+static void *worker_main(void *arg) {
+    Worker *w = arg;
+    Pool *pool = w->pool;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->generation == seen && !pool->quit) pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->quit) break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        work(pool, w->id);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0) pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    free(w);
+    return NULL;
+}
+
+Pool *pool_create(unsigned int workers) {
+    if (!workers) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? cpus : 1;
+    }
+
+    Pool *pool = calloc(1, sizeof(Pool));
+    pool->workers = workers;
+    pool->threads = malloc(workers * sizeof(pthread_t));
+    pool->shares = calloc(workers, sizeof(Share));
+    for (unsigned int i = 0; i < workers; ++i) pthread_mutex_init(&pool->shares[i].lock, NULL);
+    pthread_mutex_init(&pool->running, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (unsigned int i = 1; i < workers; ++i) {
+        Worker *w = malloc(sizeof(Worker));
+        *w = (Worker){ pool, i };
+        pthread_create(&pool->threads[i], NULL, worker_main, w);
+    }
+    return pool;
+}
+
+void pool_destroy(Pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned int i = 1; i < pool->workers; ++i) pthread_join(pool->threads[i], NULL);
+    for (unsigned int i = 0; i < pool->workers; ++i) pthread_mutex_destroy(&pool->shares[i].lock);
+    pthread_mutex_destroy(&pool->running);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->shares);
+    free(pool->threads);
+    free(pool);
+}
+
+unsigned int pool_size(Pool *pool) {
+    return pool->workers;
+}
+
+void pool_run(Pool *pool, Task task, void *arg, unsigned int count) {
+    if (!count) return;
+    if (pool->workers == 1 || count == 1) {
+        for (unsigned int i = 0; i < count; ++i) task(arg, i, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->running);
+    // contiguous shares, so neighbouring indices tend to stay on one worker
+    for (unsigned int i = 0; i < pool->workers; ++i) {
+        pool->shares[i].begin = (unsigned long)count * i / pool->workers;
+        pool->shares[i].end = (unsigned long)count * (i + 1) / pool->workers;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->arg = arg;
+    pool->busy = pool->workers - 1;
+    ++pool->generation;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    work(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy) pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_unlock(&pool->running);
+}
@@ -0,0 +1,21 @@
+#ifndef POOL_H
+#define POOL_H
+
+// Work-stealing thread pool for parallel loops. Each worker starts with
+// its own share of the indices, and steals half of someone else's
+// remaining share when it runs out.
+
+typedef void (*Task)(void *arg, unsigned int index, unsigned int worker);
+
+typedef struct Pool Pool;
+
+Pool *pool_create(unsigned int workers); // 0 for one per CPU
+void pool_destroy(Pool *pool);
+unsigned int pool_size(Pool *pool);
+
+// Call task(arg, i, worker) for every i < count and wait for all of them.
+// The calling thread works too, as worker 0. Runs started from several
+// threads take turns, but a task mustn't start a run on its own pool.
+void pool_run(Pool *pool, Task task, void *arg, unsigned int count);
+
+#endif
@@ -0,0 +1,357 @@
+#include "roots.h"
+#include "batch.h"
+#include "poly.h"
+#include "derive.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define PI 3.14159265358979323846f
+#define CHUNK 256              // boundary points per pool task
+#define FIRST_SAMPLES 16       // per side
+#define MAX_SAMPLES (1 << 16)  // per side
+#define MAX_SWEEPS 500         // of Aberth-Ehrlich
+
+typedef struct Query {
+    Kernel k;
+    const Complex *params;
+    Pool *pool;
+    Complex *zs, *ws;
+    unsigned int n, capacity;
+} Query;
+
+static void evaluate_chunk(void *arg, unsigned int index, unsigned int worker) {
+    Query *q = arg;
+    unsigned int begin = index * CHUNK;
+    unsigned int n = q->n - begin < CHUNK ? q->n - begin : CHUNK;
+    Complex *outs[256] = { NULL };
+    outs[q->k.outputs - 1] = q->ws + begin;
+    run_kernel(q->k, q->zs + begin, n, q->params, outs);
+}
+
+// Counter-clockwise from the bottom left corner, samples points per side
+static void boundary(Query *q, Box r, unsigned int samples) {
+    q->n = 4 * samples;
+    if (q->n > q->capacity) {
+        q->capacity = q->n;
+        q->zs = realloc(q->zs, q->capacity * sizeof(Complex));
+        q->ws = realloc(q->ws, q->capacity * sizeof(Complex));
+    }
+    float w = r.real.hi - r.real.lo, h = r.imag.hi - r.imag.lo;
+    for (unsigned int i = 0; i < samples; ++i) {
+        float t = (float)i / samples;
+        q->zs[i]               = (Complex){ r.real.lo + t * w, r.imag.lo };
+        q->zs[samples + i]     = (Complex){ r.real.hi, r.imag.lo + t * h };
+        q->zs[2 * samples + i] = (Complex){ r.real.hi - t * w, r.imag.hi };
+        q->zs[3 * samples + i] = (Complex){ r.real.lo, r.imag.hi - t * h };
+    }
+}
+
+static bool winding(Query *q, Box r, int *count) {
+    for (unsigned int samples = FIRST_SAMPLES; samples <= MAX_SAMPLES; samples *= 2) {
+        boundary(q, r, samples);
+        unsigned int chunks = (q->n + CHUNK - 1) / CHUNK;
+        if (q->pool) pool_run(q->pool, evaluate_chunk, q, chunks);
+        else for (unsigned int i = 0; i < chunks; ++i) evaluate_chunk(q, i, 0);
+
+        float total = 0;
+        bool fine = true;
+        for (unsigned int i = 0; i < q->n; ++i) {
+            Complex a = q->ws[i], b = q->ws[(i + 1) % q->n];
+            if (!isfinite(a.real) || !isfinite(a.imag) || (a.real == 0 && a.imag == 0)) return false;
+            // the turn from a to b is arg(b conj(a))
+            float turn = atan2f(b.imag * a.real - b.real * a.imag, b.real * a.real + b.imag * a.imag);
+            if (fabsf(turn) > PI / 2) {
+                fine = false;
+                break;
+            }
+            total += turn;
+        }
+        if (!fine) continue;
+        // a zero on the boundary can still leave a turn that isn't whole
+        float turns = total / (2 * PI);
+        *count = (int)lroundf(turns);
+        return fabsf(turns - *count) < 0.25f;
+    }
+    return false;
+}
+
+bool count_zeros(Bytecode bc, Box region, const Complex *params, Pool *pool, int *count) {
+    Query q = { hoist(bc), params, pool, NULL, NULL, 0, 0 };
+    bool counted = winding(&q, region, count);
+    free(q.zs);
+    free(q.ws);
+    free_kernel(&q.k);
+    return counted;
+}
+
+typedef struct Found {
+    RootBox *out;
+    unsigned int max, count;
+} Found;
+
+static void found(Found *f, Box box, int count) {
+    if (f->count < f->max) f->out[f->count] = (RootBox){ box, count };
+    ++f->count;
+}
+
+static void locate(Query *q, Box r, int count, float tolerance, Found *out) {
+    if (count == 0) return;
+    bool split_x = r.real.hi - r.real.lo > tolerance, split_y = r.imag.hi - r.imag.lo > tolerance;
+    if (!split_x && !split_y) {
+        found(out, r, count);
+        return;
+    }
+
+    // a cut right through a zero can't be counted, so try somewhere else.
+    // Off center, since zeros like to sit at round numbers.
+    static const float cuts[] = { 0.4871f, 0.5293f, 0.4417f, 0.5631f, 0.3923f };
+    for (unsigned int c = 0; c < sizeof(cuts) / sizeof(cuts[0]); ++c) {
+        float mx = split_x ? r.real.lo + (r.real.hi - r.real.lo) * cuts[c] : r.real.hi;
+        float my = split_y ? r.imag.lo + (r.imag.hi - r.imag.lo) * cuts[c] : r.imag.hi;
+        Box parts[4] = {
+            { { r.real.lo, mx }, { r.imag.lo, my } },
+            { { mx, r.real.hi }, { r.imag.lo, my } },
+            { { r.real.lo, mx }, { my, r.imag.hi } },
+            { { mx, r.real.hi }, { my, r.imag.hi } },
+        };
+        int counts[4] = { 0 };
+        int total = 0;
+        bool counted = true;
+        for (unsigned int i = 0; i < 4 && counted; ++i) {
+            bool used = (split_x || i % 2 == 0) && (split_y || i < 2);
+            if (used) counted = winding(q, parts[i], &counts[i]);
+            total += counts[i];
+        }
+        if (!counted || total != count) continue;
+
+        for (unsigned int i = 0; i < 4; ++i) locate(q, parts[i], counts[i], tolerance, out);
+        return;
+    }
+    // no clean cut, so report it as it is
+    found(out, r, count);
+}
+
+unsigned int locate_zeros(Bytecode bc, Box region, const Complex *params, Pool *pool,
+                          float tolerance, RootBox *out, unsigned int max) {
+    Query q = { hoist(bc), params, pool, NULL, NULL, 0, 0 };
+    Found f = { out, max, 0 };
+    int count;
+    if (winding(&q, region, &count)) locate(&q, region, count, tolerance, &f);
+    free(q.zs);
+    free(q.ws);
+    free_kernel(&q.k);
+    return f.count;
+}
+
+// Estimates for every root, structure of arrays so the loops over them vectorise
+typedef struct Estimates {
+    unsigned int n;
+    double *re, *im;
+    double *step_re, *step_im; // Newton steps, then Aberth's
+    unsigned char *done;
+} Estimates;
+
+// p(z) / p'(z) for every estimate. Outside the unit circle p(z) = z^d q(1/z)
+// with q the coefficients reversed, which keeps Horner from overflowing:
+// p / p' = z / (d - y q'(y) / q(y)) with y = 1/z.
+static void newton_steps(const double *c_re, const double *c_im, unsigned int d, Estimates *e) {
+    unsigned int n = e->n;
+    double *y_re = malloc(n * sizeof(double)), *y_im = malloc(n * sizeof(double));
+    double *p_re = calloc(n, sizeof(double)), *p_im = calloc(n, sizeof(double));
+    double *dp_re = calloc(n, sizeof(double)), *dp_im = calloc(n, sizeof(double));
+    unsigned char *flip = malloc(n);
+
+    for (unsigned int i = 0; i < n; ++i) {
+        double m = e->re[i] * e->re[i] + e->im[i] * e->im[i];
+        flip[i] = m > 1;
+        y_re[i] = flip[i] ? e->re[i] / m : e->re[i];
+        y_im[i] = flip[i] ? -e->im[i] / m : e->im[i];
+    }
+    for (unsigned int k = 0; k <= d; ++k) {
+        for (unsigned int i = 0; i < n; ++i) {
+            // coefficient d - k going forwards, k going backwards
+            double cr = flip[i] ? c_re[k] : c_re[d - k], ci = flip[i] ? c_im[k] : c_im[d - k];
+            double dr = dp_re[i] * y_re[i] - dp_im[i] * y_im[i] + p_re[i];
+            double di = dp_re[i] * y_im[i] + dp_im[i] * y_re[i] + p_im[i];
+            double pr = p_re[i] * y_re[i] - p_im[i] * y_im[i] + cr;
+            double pi = p_re[i] * y_im[i] + p_im[i] * y_re[i] + ci;
+            dp_re[i] = dr;
+            dp_im[i] = di;
+            p_re[i] = pr;
+            p_im[i] = pi;
+        }
+    }
+    for (unsigned int i = 0; i < n; ++i) {
+        // forwards p / p', backwards z / (d - y q' / q)
+        double a_re = flip[i] ? e->re[i] : p_re[i], a_im = flip[i] ? e->im[i] : p_im[i];
+        double b_re = dp_re[i], b_im = dp_im[i];
+        if (flip[i]) {
+            double m = p_re[i] * p_re[i] + p_im[i] * p_im[i];
+            if (m == 0) {
+                // right on a root
+                e->step_re[i] = e->step_im[i] = 0;
+                continue;
+            }
+            double t_re = y_re[i] * dp_re[i] - y_im[i] * dp_im[i], t_im = y_re[i] * dp_im[i] + y_im[i] * dp_re[i];
+            b_re = d - (t_re * p_re[i] + t_im * p_im[i]) / m;
+            b_im = -(t_im * p_re[i] - t_re * p_im[i]) / m;
+        }
+        double m = b_re * b_re + b_im * b_im;
+        e->step_re[i] = (a_re * b_re + a_im * b_im) / m;
+        e->step_im[i] = (a_im * b_re - a_re * b_im) / m;
+    }
+
+    free(flip);
+    free(dp_im);
+    free(dp_re);
+    free(p_im);
+    free(p_re);
+    free(y_im);
+    free(y_re);
+}
+
+int polynomial_roots(Bytecode bc, const Complex *params, float tolerance, Complex *out, unsigned int max) {
+    Complex *c = malloc((MAX_POLY_DEGREE + 1) * sizeof(Complex));
+    int degree = polynomial_coefficients(bc, params, MAX_POLY_DEGREE, c);
+    if (degree <= 0) {
+        free(c);
+        return degree;
+    }
+
+    // roots at 0 come straight off the bottom
+    unsigned int zeros = 0;
+    while (zeros < (unsigned int)degree && c[zeros].real == 0.0f && c[zeros].imag == 0.0f) ++zeros;
+    for (unsigned int i = 0; i < zeros && i < max; ++i) out[i] = (Complex){ 0.0f, 0.0f };
+    unsigned int d = degree - zeros;
+    double *c_re = malloc((d + 1) * sizeof(double)), *c_im = malloc((d + 1) * sizeof(double));
+    for (unsigned int k = 0; k <= d; ++k) {
+        c_re[k] = c[zeros + k].real;
+        c_im[k] = c[zeros + k].imag;
+    }
+
+    // start spread around a circle with the roots' geometric mean size, off the axes
+    Estimates e = { d };
+    e.re = malloc(d * sizeof(double));
+    e.im = malloc(d * sizeof(double));
+    e.step_re = malloc(d * sizeof(double));
+    e.step_im = malloc(d * sizeof(double));
+    e.done = calloc(d ? d : 1, 1);
+    double r = pow(hypot(c_re[0], c_im[0]) / hypot(c_re[d], c_im[d]), 1.0 / d);
+    if (!isfinite(r) || r == 0) r = 1;
+    for (unsigned int i = 0; i < d; ++i) {
+        e.re[i] = r * cos(2 * M_PI * i / d + 0.4);
+        e.im[i] = r * sin(2 * M_PI * i / d + 0.4);
+    }
+
+    unsigned int left = d;
+    for (unsigned int sweep = 0; sweep < MAX_SWEEPS && left; ++sweep) {
+        newton_steps(c_re, c_im, d, &e);
+
+        // Aberth's correction w = N / (1 - N sum 1 / (z_i - z_j)), every estimate at once
+        for (unsigned int i = 0; i < d; ++i) {
+            if (e.done[i]) continue;
+            double s_re = 0, s_im = 0;
+            for (unsigned int j = 0; j < d; ++j) {
+                double dr = e.re[i] - e.re[j], di = e.im[i] - e.im[j];
+                double m = j == i ? 1 : dr * dr + di * di;
+                s_re += j == i ? 0 : dr / m;
+                s_im -= j == i ? 0 : di / m;
+            }
+            double n_re = e.step_re[i], n_im = e.step_im[i];
+            double q_re = 1 - (n_re * s_re - n_im * s_im), q_im = -(n_re * s_im + n_im * s_re);
+            double m = q_re * q_re + q_im * q_im;
+            e.step_re[i] = (n_re * q_re + n_im * q_im) / m;
+            e.step_im[i] = (n_im * q_re - n_re * q_im) / m;
+        }
+        for (unsigned int i = 0; i < d; ++i) {
+            if (e.done[i] || !isfinite(e.step_re[i]) || !isfinite(e.step_im[i])) continue;
+            e.re[i] -= e.step_re[i];
+            e.im[i] -= e.step_im[i];
+            if (hypot(e.step_re[i], e.step_im[i]) <= tolerance * hypot(e.re[i], e.im[i])) {
+                e.done[i] = 1;
+                --left;
+            }
+        }
+    }
+    for (unsigned int i = 0; i < d && zeros + i < max; ++i) out[zeros + i] = (Complex){ e.re[i], e.im[i] };
+
+    free(e.done);
+    free(e.step_im);
+    free(e.step_re);
+    free(e.im);
+    free(e.re);
+    free(c_im);
+    free(c_re);
+    free(c);
+    return degree;
+}
+
+typedef struct Solve {
+    Kernel k; // f and f' for every output
+    const Complex *params;
+    Complex w;
+    Complex *zs;
+    unsigned int n;
+    float tolerance;
+    unsigned int max_steps;
+    bool *converged;
+    unsigned int *found; // per worker
+} Solve;
+
+// One chunk of starts. The ones still going get packed to the front each
+// step, so the kernel only ever runs on live lanes.
+static void solve_chunk(void *arg, unsigned int index, unsigned int worker) {
+    Solve *s = arg;
+    unsigned int begin = index * CHUNK;
+    unsigned int n = s->n - begin < CHUNK ? s->n - begin : CHUNK;
+    Complex zs[CHUNK], fs[CHUNK], dfs[CHUNK];
+    unsigned int lanes[CHUNK], live = 0;
+    for (unsigned int i = 0; i < n; ++i) {
+        s->converged[begin + i] = false;
+        lanes[live++] = begin + i;
+    }
+
+    unsigned int outputs = s->k.outputs / 2;
+    Complex *outs[256] = { NULL };
+    outs[outputs - 1] = fs;
+    outs[2 * outputs - 1] = dfs;
+    for (unsigned int step = 0; step < s->max_steps && live; ++step) {
+        for (unsigned int i = 0; i < live; ++i) zs[i] = s->zs[lanes[i]];
+        run_kernel(s->k, zs, live, s->params, outs);
+
+        unsigned int still = 0;
+        for (unsigned int i = 0; i < live; ++i) {
+            Complex d = complex_div(complex_sub(fs[i], s->w), dfs[i]);
+            if (!isfinite(d.real) || !isfinite(d.imag)) continue; // f' = 0 or worse, so give up on it
+            Complex z = complex_sub(zs[i], d);
+            s->zs[lanes[i]] = z;
+            if (hypotf(d.real, d.imag) <= s->tolerance * fmaxf(1.0f, hypotf(z.real, z.imag))) {
+                s->converged[lanes[i]] = true;
+                ++s->found[worker];
+            } else {
+                lanes[still++] = lanes[i];
+            }
+        }
+        live = still;
+    }
+}
+
+unsigned int solve_preimages(Bytecode bc, const Complex *params, Complex w, Complex *zs, unsigned int n,
+                             float tolerance, unsigned int max_steps, Pool *pool, bool *converged) {
+    Bytecode derived = derive(bc);
+    unsigned int workers = pool ? pool_size(pool) : 1;
+    Solve s = { hoist(derived), params, w, zs, n, tolerance, max_steps, converged, calloc(workers, sizeof(unsigned int)) };
+    if (!converged) s.converged = malloc(n * sizeof(bool));
+
+    unsigned int chunks = (n + CHUNK - 1) / CHUNK;
+    if (pool) pool_run(pool, solve_chunk, &s, chunks);
+    else for (unsigned int i = 0; i < chunks; ++i) solve_chunk(&s, i, 0);
+
+    unsigned int total = 0;
+    for (unsigned int i = 0; i < workers; ++i) total += s.found[i];
+    if (!converged) free(s.converged);
+    free(s.found);
+    free_kernel(&s.k);
+    free(derived.data);
+    return total;
+}
@@ -0,0 +1,42 @@
+#ifndef ROOTS_H
+#define ROOTS_H
+
+#include "interval.h"
+#include "pool.h"
+
+// Zeros minus poles of the last output inside region, counted with
+// multiplicity, by the argument principle: how many times f winds around 0
+// while z goes once around the boundary. Boundary points are evaluated on
+// pool (NULL to stay on this thread), and sampled more densely until f turns
+// less than a quarter turn between neighbours. Returns false when f is zero
+// or not finite on the boundary, or turns too fast to follow.
+bool count_zeros(Bytecode bc, Box region, const Complex *params, Pool *pool, int *count);
+
+typedef struct RootBox {
+    Box box;
+    int count; // zeros minus poles inside
+} RootBox;
+
+// Quarter region again and again, dropping the parts that count nothing,
+// until what's left is at most tolerance wide. Parts where a zero and a pole
+// cancel out get dropped too. Writes up to max boxes to out and returns how
+// many there were, or 0 if region's own boundary can't be counted.
+unsigned int locate_zeros(Bytecode bc, Box region, const Complex *params, Pool *pool,
+                          float tolerance, RootBox *out, unsigned int max);
+
+// Every root of the last output, which has to be a polynomial in z, repeated
+// by multiplicity. Aberth-Ehrlich iteration on all of them at once until each
+// moves less than tolerance times its size. Writes up to max roots to out and
+// returns the degree, or -1 if the program isn't a polynomial.
+int polynomial_roots(Bytecode bc, const Complex *params, float tolerance, Complex *out, unsigned int max);
+
+// Newton's method for f(z) = w, f being the last output, from all n starts
+// in zs at once, on pool (NULL to stay on this thread). Each start stops once
+// its step is under tolerance times |z| (or just tolerance inside the unit
+// circle), or it hits f' = 0 or max_steps.
+// zs gets the solutions. converged, if not NULL, says which got there.
+// Returns how many did.
+unsigned int solve_preimages(Bytecode bc, const Complex *params, Complex w, Complex *zs, unsigned int n,
+                             float tolerance, unsigned int max_steps, Pool *pool, bool *converged);
+
+#endif
@@ -0,0 +1,25 @@
+#include "../batch.h"
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+    Lexer lexer = { "#s = sin(z)*a; f(w) = w*w + s; g(w) = f(w) - f(2*w); g(z + 1)/s", 0, {0, false, NULL}};
+    Bytecode out = { 16, malloc(16) };
+    Parser parser = { &lexer, out, 0 };
+    compile(&parser);
+    out = parser.out;
+
+    disasm(out);
+
+    Complex params[MAX_PARAMS] = { { 3.0f, 0.0f } };
+    Complex zs[20], results[20];
+    for (unsigned int i = 0; i < 20; ++i) zs[i] = (Complex){ 0.5f, i * 0.1f };
+    run_batch(out, zs, 20, params, results);
+
+    // g(z+1)/s with s = 3 sin(z) is ((z+1)^2 - 4(z+1)^2) / (3 sin z)
+    Complex w = complex_add(zs[19], (Complex){ 1.0f, 0.0f });
+    Complex s = complex_mul(params[0], complex_sin(zs[19]));
+    print_comp(complex_div(complex_mul((Complex){ -3.0f, 0.0f }, complex_mul(w, w)), s));
+    print_comp(run(out, zs[19], params));
+    print_comp(results[19]);
+    return 0;
+}
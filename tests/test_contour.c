@@ -0,0 +1,140 @@
+#include "../complexia_graph/contour.h"
+#include "../complexia_graph/coloring.h"
+#include "../complexia_graph/raster.h"
+#include "../complexia_graph/progressive.h"
+#include "../complexia_graph/tiles.h"
+#include "../complexia_graph/async.h"
+#include "../complexia_graph/pipeline.h"
+#include "../complexia_graph/levels.h"
+#include <math.h>
+#include <time.h>
+
+static double seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    Lexer lexer = { "#|z| - 1", 0, {0, false, NULL}};
+    Bytecode out = { 1024, malloc(1024) };
+    Parser parser = { &lexer, out, 0 };
+    compile(&parser);
+    out = parser.out;
+
+    // the unit circle, 40 pixels across, in the middle of a 200 by 100 view
+    View view = { { 0, 0 }, 1.0f / 40 };
+    Contours contours = { 0 };
+    double start = seconds();
+    contour(out, NULL, view, 200, 100, 1.0f, &contours);
+    printf("%u segments, %u polylines in %f s\n", contours.lines.count, contours.polylines.count, seconds() - start);
+
+    float worst = 0;
+    for (unsigned int i = 0; i < contours.lines.count; ++i) {
+        Line l = contours.lines.lines[i];
+        float r = hypotf(l.x0 - 100, l.y0 - 50) / 40;
+        worst = fmaxf(worst, fabsf(r - 1) * 40);
+    }
+    printf("max radius error %f px\n", worst);
+
+    uint32_t *pixels = malloc(200 * 100 * sizeof(uint32_t));
+    Raster raster = { pixels, 200, 100, 200 * sizeof(uint32_t) };
+    clear_raster(raster, 0xff000000);
+    rasterize_polylines(raster, &contours.polylines, 0xffffffff);
+    unsigned int lit = 0;
+    for (unsigned int i = 0; i < 200 * 100; ++i) lit += pixels[i] == 0xffffffff;
+    printf("%u pixels lit\n", lit); // about the circumference, in pixel steps
+
+    start = seconds();
+    color_pixels(out, NULL, view, 200, 100, pixels, raster.pitch);
+    printf("coloured in %f s, center %08x\n", seconds() - start, pixels[50 * 200 + 100]);
+
+    // progressive: coarse first, then one level finer per frame until steady
+    Progressive p = new_progressive(1.0f / 60, 1.0f, 16.0f);
+    while (progress(&p, out, NULL, view, 200, 100))
+        printf("square size %g, %u segments\n", p.done, p.contours.lines.count);
+    free_progressive(&p);
+
+    // cached tiles: panning a little should only add a strip of tiles
+    TileCache cache = new_tile_cache(1 << 20);
+    contour_cached(&cache, out, NULL, view, 200, 100, 1.0f, 0, &contours);
+    unsigned int before = cache.count;
+    View panned = { { 1.5f, 0 }, 1.0f / 40 };
+    contour_cached(&cache, out, NULL, panned, 200, 100, 1.0f, 0, &contours);
+    printf("%u tiles, %u more after panning, %u segments in %u polylines\n", before, cache.count - before, contours.lines.count, contours.polylines.count);
+    // zoomed in, borrowing from the coarser level while one tile a frame fills in
+    View zoomed = { { 1.5f, 0 }, 1.0f / 80 };
+    unsigned int frames = 0, left;
+    do {
+        left = contour_cached(&cache, out, NULL, zoomed, 200, 100, 1.0f, 1, &contours);
+        if (!frames++) printf("%u segments while %u tiles are missing\n", contours.lines.count, left);
+    } while (left);
+    printf("%u segments after %u frames\n", contours.lines.count, frames);
+    free_tile_cache(&cache);
+
+    // neighbouring tiles agree on their shared corners, even the exact zeros at +-i
+    Lexer seam_lexer = { "#z^20 - 1", 0, {0, false, NULL}};
+    Parser seam_parser = { &seam_lexer, { 1024, malloc(1024) }, 0 };
+    compile(&seam_parser);
+    View fine = { { 0, 0 }, 1.0f / 128 };
+    Contours whole = { 0 };
+    contour(seam_parser.out, NULL, fine, 400, 400, 1.0f, &whole);
+    cache = new_tile_cache(1 << 24);
+    contour_cached(&cache, seam_parser.out, NULL, fine, 400, 400, 1.0f, 0, &contours);
+    printf("%u polylines from tiles, %u from the frame\n", contours.polylines.count, whole.polylines.count); // 20 and 20
+    free_tile_cache(&cache);
+    free_contours(&whole);
+
+    // background rendering: a burst of requests, of which only the last shows up
+    AsyncRender *a = async_create();
+    for (unsigned int i = 0; i < 10; ++i) {
+        View moving = { { i * 0.1f, 0 }, 1.0f / 40 };
+        async_request(a, out, NULL, moving, 200, 100, 1.0f);
+    }
+    View shown;
+    while (!async_take(a, &contours, &shown)) nanosleep(&(struct timespec){ 0, 1000000 }, NULL);
+    printf("background frame at %g, %u segments\n", shown.center.real, contours.lines.count);
+    async_destroy(a);
+
+    // pipelined: a few frames in flight at once, finishing in order
+    Pipeline *pipe = pipeline_create();
+    for (unsigned int i = 0; i < 3; ++i) {
+        View moving = { { i * 0.5f, 0 }, 1.0f / 40 };
+        while (!pipeline_submit(pipe, out, NULL, moving, 200, 100, 1.0f)) nanosleep(&(struct timespec){ 0, 1000000 }, NULL);
+    }
+    // the circle's center is at x = 100 - 20 i pixels in frame i, so wait for 60
+    const Contours *frame;
+    float mean;
+    do {
+        nanosleep(&(struct timespec){ 0, 1000000 }, NULL);
+        frame = pipeline_take(pipe);
+        mean = 0;
+        for (unsigned int i = 0; frame && i < frame->lines.count; ++i) mean += frame->lines.lines[i].x0 / frame->lines.count;
+    } while (fabsf(mean - 60) > 1);
+    printf("pipelined frame with %u segments around x = %f\n", frame->lines.count, mean);
+    pipeline_destroy(pipe);
+
+    // several levels from one sweep: circles |z| = 0.5, 1, 2 and rays of arg z
+    Lexer plain_lexer = { "#z", 0, {0, false, NULL}};
+    Parser plain = { &plain_lexer, { 16, malloc(16) }, 0 };
+    compile(&plain);
+    float radii[] = { 0.5f, 1, 2 };
+    float angles[8];
+    for (unsigned int k = 0; k < 8; ++k) angles[k] = (float)k * 3.14159265f / 4 - 3.14159265f;
+    Contours rings[3] = { 0 }, rays[8] = { 0 };
+    View wide = { { 0.013f, 0.007f }, 1.0f / 40 }; // off center, so rays miss the lattice corners
+    contour_levels(plain.out, NULL, wide, 200, 200, 1.0f, LEVEL_MODULUS, radii, 3, rings);
+    for (unsigned int k = 0; k < 3; ++k)
+        printf("|z| = %g: %u segments, %u polylines\n", radii[k], rings[k].lines.count, rings[k].polylines.count);
+    contour_levels(plain.out, NULL, wide, 200, 200, 1.0f, LEVEL_ARG, angles, 8, rays);
+    for (unsigned int k = 0; k < 8; ++k) {
+        printf("arg z = %g: %u segments, %u polylines\n", angles[k], rays[k].lines.count, rays[k].polylines.count);
+        free_contours(&rays[k]);
+    }
+    for (unsigned int k = 0; k < 3; ++k) free_contours(&rings[k]);
+    free(plain.out.data);
+
+    free(pixels);
+    free_contours(&contours);
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include "../derive.h"
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+    Lexer lexer = { "#sin(z^2)/(z + a) + cos(z)*z^z - log(z)", 0, {0, false, NULL}};
+    Bytecode out = { 1024, malloc(1024) };
+    Parser parser = { &lexer, out, 0 };
+    compile(&parser);
+    out = parser.out;
+
+    Bytecode d = derive(out);
+    disasm(d);
+
+    // compare against a central difference
+    Complex params[MAX_PARAMS] = { { 0.5f, 0.25f } };
+    Complex z = { 0.7f, 0.3f }, h = { 1e-3f, 0.0f };
+    Complex values[2];
+    (void) run_all(d, z, params, values);
+    Complex fd = complex_div(complex_sub(run(out, complex_add(z, h), params), run(out, complex_sub(z, h), params)),
+                             (Complex){ 2e-3f, 0.0f });
+    print_comp(values[0]);
+    print_comp(values[1]);
+    print_comp(fd);
+
+    // the derivative of a fused OP_POLY against the same polynomial in Horner form
+    Lexer fused_lexer = { "#z^10 - 3*z^7 + 2*z^4 - z + 4", 0, {0, false, NULL}};
+    Parser fused_parser = { &fused_lexer, { 1024, malloc(1024) }, 0 };
+    compile(&fused_parser);
+    Lexer horner_lexer = { "#(((z^3 - 3)*z^3 + 2)*z^3 - 1)*z + 4", 0, {0, false, NULL}};
+    Parser horner_parser = { &horner_lexer, { 1024, malloc(1024) }, 0 };
+    compile(&horner_parser);
+    (void) run_all(derive(fused_parser.out), z, NULL, values);
+    print_comp(values[1]);
+    (void) run_all(derive(horner_parser.out), z, NULL, values);
+    print_comp(values[1]);
+
+    // and of (z - 1)^12 near its root, which stays factored: 12 (0.1)^11
+    Lexer root_lexer = { "#(z - 1)^12", 0, {0, false, NULL}};
+    Parser root_parser = { &root_lexer, { 1024, malloc(1024) }, 0 };
+    compile(&root_parser);
+    (void) run_all(derive(root_parser.out), (Complex){ 1.1f, 0.0f }, NULL, values);
+    print_comp(complex_mul(values[1], (Complex){ 1e10f, 0.0f })); // 1.2
+    return 0;
+}
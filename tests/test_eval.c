@@ -1,12 +1,29 @@
 #include "../backend.h"
 #include <stdlib.h>
 
-int main(int argc, char **argv) {
-    Lexer lexer = { "#e^(i*pi)", 0, {0, false, NULL}};
+static Bytecode compile_string(char *source) {
+    Lexer lexer = { source, 0, {0, false, NULL}};
     Bytecode out = { 1024, malloc(1024) };
     Parser parser = { &lexer, out, 0 };
     compile(&parser);
+    return parser.out;
+}
+
+int main(int argc, char **argv) {
+    Bytecode out = compile_string("#e^(i*pi)");
+    print_comp(run(out, (Complex){ 0.0f, 0.0f }, NULL));
+
+    // a sum of powers becomes one OP_POLY, evaluated by Estrin from degree 8 on;
+    // the same polynomial in Horner form has sums inside products and stays as it is
+    Bytecode fused = compile_string("#z^10 - 3*z^7 + 2*z^4 - z + 4");
+    Bytecode unfused = compile_string("#(((z^3 - 3)*z^3 + 2)*z^3 - 1)*z + 4");
+    disasm(fused);
+    Complex z = { 0.9f, -0.4f };
+    print_comp(run(fused, z, NULL));
+    print_comp(run(unfused, z, NULL));
 
-    print_comp(run(out));
+    // factored forms aren't expanded, which would lose everything near the root
+    Bytecode factored = compile_string("#(z - 1)^12");
+    print_comp(complex_mul(run(factored, (Complex){ 1.1f, 0.0f }, NULL), (Complex){ 1e12f, 0.0f })); // 1
     return 0;
-}
\ No newline at end of file
+}
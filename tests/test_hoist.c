@@ -0,0 +1,71 @@
+#include "../batch.h"
+#include <math.h>
+#include <stdlib.h>
+
+static Bytecode compile_string(char *source) {
+    Lexer lexer = { source, 0, {0, false, NULL}};
+    Bytecode out = { 1024, malloc(1024) };
+    Parser parser = { &lexer, out, 0 };
+    compile(&parser);
+    return parser.out;
+}
+
+// Largest difference between run_grid and run on a 100 by 12 grid
+static float grid_error(Bytecode bc, const Complex *params) {
+    static Complex grid[100 * 12];
+    run_grid(bc, (Grid){ { -1.5f, -1.0f }, 0.03f, 0.2f, 100, 12 }, params, grid);
+    float worst = 0.0f;
+    for (unsigned int y = 0; y < 12; ++y)
+        for (unsigned int x = 0; x < 100; ++x) {
+            Complex d = complex_sub(grid[y * 100 + x], run(bc, (Complex){ -1.5f + x * 0.03f, -1.0f + y * 0.2f }, params));
+            worst = fmaxf(worst, fabsf(d.real) + fabsf(d.imag));
+        }
+    return worst;
+}
+
+int main(int argc, char **argv) {
+    Bytecode out = compile_string("#sin(a)*pi^2*z + cos(a*z) - a/2");
+
+    Kernel k = hoist(out);
+    printf("prologue:\n");
+    disasm(k.prologue);
+    printf("body:\n");
+    disasm(k.body);
+
+    Complex params[MAX_PARAMS] = { { 0.5f, 0.0f } };
+    Complex zs[32], hoisted[32];
+    for (unsigned int i = 0; i < 32; ++i) zs[i] = (Complex){ i * 0.1f, 1.0f - i * 0.05f };
+    run_batch(out, zs, 32, params, hoisted);
+
+    // both paths should agree
+    print_comp(run(out, zs[31], params));
+    print_comp(hoisted[31]);
+
+    // cos(a*z) comes out of per row and per column tables on a grid
+    printf("separable: %u, grid error %g\n", k.separable_count, grid_error(out, params));
+
+    // and sums of powers of z by forward differences along rows
+    Bytecode poly = compile_string("#z^4 - 2*a*z^3 + (a*a + 1)*z^2 - 2*a*z + a*a + z/a");
+    Kernel pk = hoist(poly);
+    printf("degree: %u, grid error %g\n", pk.degree, grid_error(poly, params));
+
+    // and high degree polynomials around circles by FFT, here with a length that isn't a power of two
+    Bytecode circle = compile_string("#z^24 - 12*z^22 + 66*z^20 - 5*z^9 + z^2 + 2*z - a");
+    Kernel ck = hoist(circle);
+    Complex around[96], fast[96];
+    for (unsigned int i = 0; i < 96; ++i) around[i] = (Complex){ 0.9f * cosf(i * 6.2831853f / 96), 0.9f * sinf(i * 6.2831853f / 96) };
+    run_batch(circle, around, 96, params, fast);
+    float worst = 0.0f;
+    for (unsigned int i = 0; i < 96; ++i) {
+        Complex slow = run(circle, around[i], params), d = complex_sub(fast[i], slow);
+        worst = fmaxf(worst, (fabsf(d.real) + fabsf(d.imag)) / fmaxf(1.0f, fabsf(slow.real) + fabsf(slow.imag)));
+    }
+    printf("table degree: %u, relative circle error %g\n", ck.table_degree, worst);
+
+    free_kernel(&ck);
+    free_kernel(&pk);
+    free_kernel(&k);
+    free(circle.data);
+    free(poly.data);
+    return 0;
+}
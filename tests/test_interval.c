@@ -0,0 +1,26 @@
+#include "../interval.h"
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+    Lexer lexer = { "#a = sin(z)*cos(z/2); a/(z - 3) + z^3 - |z|*log(z + 2) + 2^z", 0, {0, false, NULL}};
+    Bytecode out = { 1024, malloc(1024) };
+    Parser parser = { &lexer, out, 0 };
+    compile(&parser);
+    out = parser.out;
+
+    Box box = { { -0.5f, 0.25f }, { 0.1f, 0.6f } };
+    Box bound = run_box(out, box, NULL);
+    printf("Re in [%f, %f], Im in [%f, %f]\n", bound.real.lo, bound.real.hi, bound.imag.lo, bound.imag.hi);
+
+    // every sample has to land inside the bound
+    unsigned int outside = 0;
+    for (unsigned int i = 0; i <= 20; ++i) {
+        for (unsigned int j = 0; j <= 20; ++j) {
+            Complex z = { box.real.lo + (box.real.hi - box.real.lo) * i / 20, box.imag.lo + (box.imag.hi - box.imag.lo) * j / 20 };
+            Complex w = run(out, z, NULL);
+            if (w.real < bound.real.lo || w.real > bound.real.hi || w.imag < bound.imag.lo || w.imag > bound.imag.hi) ++outside;
+        }
+    }
+    printf("%u samples outside\n", outside);
+    return 0;
+}
@@ -0,0 +1,25 @@
+#include "../batch.h"
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+    Lexer lexer = { "#f(w) = w^3 - a*w; f(z); 3*z^2 - a; |f(z)|", 0, {0, false, NULL}};
+    Bytecode out = { 1024, malloc(1024) };
+    Parser parser = { &lexer, out, 0 };
+    compile(&parser);
+    out = parser.out;
+
+    printf("%u outputs\n", parser.output_count);
+    disasm(out);
+
+    Complex params[MAX_PARAMS] = { { 2.0f, 0.0f } };
+    Complex zs[64], f[64], df[64], mag[64];
+    for (unsigned int i = 0; i < 64; ++i) zs[i] = (Complex){ -1.0f + i / 32.0f, 0.5f };
+
+    Complex *outs[3] = { f, df, mag };
+    run_batch_all(out, zs, 64, params, outs);
+    print_comp(f[40]);
+    print_comp(df[40]);
+    print_comp(mag[40]);
+    print_comp(run(out, zs[40], params));
+    return 0;
+}
@@ -0,0 +1,23 @@
+#include "../batch.h"
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+    Lexer lexer = { "#a*z^2 + omega", 0, {0, false, NULL}};
+    Bytecode out = { 1024, malloc(1024) };
+    Parser parser = { &lexer, out, 0 };
+    compile(&parser);
+    out = parser.out;
+
+    disasm(out);
+
+    // changing a parameter doesn't need a recompile
+    Complex params[2] = { { 2.0f, 0.0f }, { 0.0f, 1.0f } };
+    Complex zs[3] = { { 1.0f, 0.0f }, { 0.0f, 1.0f }, { 2.0f, 0.0f } };
+    Complex results[3];
+    run_batch(out, zs, 3, params, results);
+    for (unsigned int i = 0; i < 3; ++i) print_comp(results[i]);
+
+    params[param_slot(&parser, "a")] = (Complex){ -1.0f, 0.0f };
+    print_comp(run(out, zs[0], params));
+    return 0;
+}
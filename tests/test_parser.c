@@ -6,6 +6,7 @@ int main(int argc, char **argv) {
     Bytecode out = { 1024, malloc(1024) };
     Parser parser = { &lexer, out, 0 };
     compile(&parser);
+    out = parser.out;
 
     disasm(out);
     return 0;
@@ -0,0 +1,26 @@
+#include "../pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void square(void *arg, unsigned int index, unsigned int worker) {
+    unsigned long *out = arg;
+    out[index] = (unsigned long)index * index;
+}
+
+int main(int argc, char **argv) {
+    Pool *pool = pool_create(8);
+    unsigned long *out = malloc(100000 * sizeof(unsigned long));
+
+    // run a few times, to check the pool can be reused
+    for (unsigned int round = 0; round < 3; ++round) {
+        pool_run(pool, square, out, 100000);
+
+        unsigned long sum = 0;
+        for (unsigned int i = 0; i < 100000; ++i) sum += out[i];
+        printf("%lu\n", sum); // 333328333350000
+    }
+
+    free(out);
+    pool_destroy(pool);
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include "../roots.h"
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+    // zeros at 0 (twice), 1 + i and -2, pole at 0.5 - 0.5i
+    Lexer lexer = { "#z^2*(z - 1 - i)*(z + 2)/(z - 0.5 + 0.5*i)", 0, {0, false, NULL}};
+    Bytecode out = { 1024, malloc(1024) };
+    Parser parser = { &lexer, out, 0 };
+    compile(&parser);
+    out = parser.out;
+
+    Complex params[MAX_PARAMS] = { { 0, 0 } };
+    Pool *pool = pool_create(4);
+
+    int count;
+    if (count_zeros(out, (Box){ { -3, 3 }, { -3, 3 } }, params, pool, &count))
+        printf("%d zeros minus poles\n", count); // 3
+    if (count_zeros(out, (Box){ { 0.25f, 3 }, { -3, 3 } }, params, pool, &count))
+        printf("%d zeros minus poles\n", count); // 0
+
+    RootBox boxes[16];
+    unsigned int n = locate_zeros(out, (Box){ { -3, 3 }, { -3.1f, 2.9f } }, params, pool, 1e-3f, boxes, 16);
+    for (unsigned int i = 0; i < n && i < 16; ++i)
+        printf("%d in [%f, %f] x [%f, %f]\n", boxes[i].count,
+               boxes[i].box.real.lo, boxes[i].box.real.hi, boxes[i].box.imag.lo, boxes[i].box.imag.hi);
+
+    // all the roots of a polynomial at once: i and -i, and 0.5 three times
+    Lexer poly_lexer = { "#(z*z + 1)*(z - 0.5)^3", 0, {0, false, NULL}};
+    Parser poly_parser = { &poly_lexer, { 1024, malloc(1024) }, 0 };
+    compile(&poly_parser);
+    Complex roots[5];
+    int degree = polynomial_roots(poly_parser.out, NULL, 1e-7f, roots, 5);
+    for (int i = 0; i < degree; ++i) print_comp(roots[i]);
+
+    // Newton from a line of starts onto the two square roots of 2i, 1 + i and -1 - i
+    Lexer square_lexer = { "#z^2", 0, {0, false, NULL}};
+    Parser square_parser = { &square_lexer, { 1024, malloc(1024) }, 0 };
+    compile(&square_parser);
+    Complex starts[300];
+    bool converged[300];
+    for (unsigned int i = 0; i < 300; ++i) starts[i] = (Complex){ -3.0f + i * 0.02f, 0.1f };
+    unsigned int solved = solve_preimages(square_parser.out, NULL, (Complex){ 0, 2 }, starts, 300, 1e-6f, 50, pool, converged);
+    printf("%u of 300 converged\n", solved);
+    print_comp(starts[0]);
+    print_comp(starts[299]);
+
+    pool_destroy(pool);
+    return 0;
+}
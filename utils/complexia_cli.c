@@ -13,8 +13,17 @@ int main(int argc, char **argv) {
         Bytecode out = { 1024, malloc(1024) };
         Parser parser = { &lexer, out, 0 };
         compile(&parser);
+        out = parser.out;
 
-        print_comp(run(out));
+        // ask for the value of each named parameter
+        Complex params[MAX_PARAMS];
+        for (unsigned int i = 0; i < parser.param_count; ++i) {
+            params[i] = (Complex){ 0.0f, 0.0f };
+            printf("%s = ", parser.params[i]);
+            scanf("%f", &params[i].real);
+        }
+
+        print_comp(run(out, (Complex){ 0.0f, 0.0f }, params));
     }
 
     return 0;